@@ -0,0 +1,353 @@
+#include <libdragon.h>
+
+#include "audio.h"
+#include "memory.h"
+#include "stats.h"
+
+/* Frames averaged for each cost measurement */
+#define PFU_AUDIO_WINDOW 60
+
+/* Output samples per frame at the highest output rate, plus rounding */
+#define PFU_AUDIO_MAX_SAMPLES (PF_SOUND_SAMPLES + 2)
+
+static const unsigned pfu_audio_frequencies[PFU_AUDIO_RATE_SIZE] = {
+  44100,
+  32000,
+  22050
+};
+
+/**
+ * A change in beeper level, at a position in the input in 16.16 fixed point.
+ */
+typedef struct
+{
+  u32 position;
+  int delta;
+} pfu_audio_event_t;
+
+typedef struct
+{
+  pfu_audio_stats_t stats;
+  pfu_audio_synth synth;
+  bool initialized;
+  int heap_used;
+
+  /* Emulated CPU clock multiplier, in halves */
+  unsigned overclock_halves;
+
+  /**
+   * Input samples advanced per output sample, and input samples played per
+   * frame, in 16.16 fixed point. With an overclock, a frame of input covers
+   * more guest time than a frame of output, so it is first folded into the
+   * played length to keep the guest's pitch.
+   */
+  u32 step;
+  u32 end;
+
+  /* One frame of input folded into the played length, left channel only */
+  short folded[PF_SOUND_SAMPLES * 2];
+
+  /* Position of the next output sample in the input, in 16.16 fixed point */
+  u32 phase;
+
+  /**
+   * Interleaved stereo output, reused every frame. Band-limited synthesis
+   * keeps the previous frame's last sample in the first slot.
+   */
+  short output[(PFU_AUDIO_MAX_SAMPLES + 1) * 2];
+
+  /* Level changes in the current frame, and the level at its end */
+  pfu_audio_event_t events[PF_SOUND_SAMPLES];
+  int level;
+
+  /**
+   * Edges near a frame boundary smooth samples in the neighbouring frame.
+   * The last sample of each frame is held back until the next frame, so an
+   * edge at its start can still adjust it, and the residual of an edge at
+   * the end is carried over to the next frame's first sample.
+   */
+  short held;
+  int carry;
+
+  u32 resample_ticks;
+  u32 push_ticks;
+  unsigned window_frames;
+} pfu_audio_t;
+
+static pfu_audio_t audio;
+
+void pfu_audio_init(pfu_audio_rate rate)
+{
+  unsigned heap_used;
+
+  if (rate >= PFU_AUDIO_RATE_SIZE)
+    return;
+
+  if (audio.initialized)
+  {
+    pfu_stats_log("audio frequency=%u resample_us=%u push_us=%u",
+                  audio.stats.frequency, audio.stats.resample_us,
+                  audio.stats.push_us);
+    audio_close();
+    pfu_memory_account(PFU_MEMORY_AUDIO, -audio.heap_used);
+  }
+
+  heap_used = pfu_memory_heap_used();
+  audio_init(pfu_audio_frequencies[rate], 4);
+  audio.heap_used = pfu_memory_heap_used() - heap_used;
+  pfu_memory_account(PFU_MEMORY_AUDIO, audio.heap_used);
+
+  audio.initialized = true;
+  audio.stats.frequency = audio_get_frequency();
+  audio.stats.resample_us = 0;
+  audio.stats.push_us = 0;
+  if (!audio.overclock_halves)
+    audio.overclock_halves = 2;
+  audio.step = (u32)(((unsigned long long)PF_SOUND_FREQUENCY << 17) /
+                     audio.stats.frequency / audio.overclock_halves);
+  audio.end = ((u32)PF_SOUND_SAMPLES << 17) / audio.overclock_halves;
+  audio.phase = 0;
+  audio.held = audio.level;
+  audio.carry = 0;
+  audio.resample_ticks = 0;
+  audio.push_ticks = 0;
+  audio.window_frames = 0;
+}
+
+void pfu_audio_set_overclock(unsigned halves)
+{
+  if (halves < 2 || halves == audio.overclock_halves)
+    return;
+  audio.overclock_halves = halves;
+  if (!audio.initialized)
+    return;
+  audio.step = (u32)(((unsigned long long)PF_SOUND_FREQUENCY << 17) /
+                     audio.stats.frequency / halves);
+  audio.end = ((u32)PF_SOUND_SAMPLES << 17) / halves;
+  audio.phase = 0;
+}
+
+void pfu_audio_set_synth(pfu_audio_synth synth)
+{
+  if (synth < PFU_AUDIO_SYNTH_SIZE)
+  {
+    audio.synth = synth;
+    audio.held = audio.level;
+    audio.carry = 0;
+  }
+}
+
+/**
+ * Folds one frame of input into the length played when overclocked. Each
+ * played position is the average of the input at that position in every
+ * piece of the frame, so beeps anywhere in it are heard at the guest's
+ * pitch. Returns the input unchanged without an overclock.
+ */
+static const short *pfu_audio_fold(const short *samples)
+{
+  /* One sample past the played length, for interpolation */
+  const unsigned length = ((audio.end + 0xFFFF) >> 16) + 1;
+  unsigned i;
+
+  if (audio.overclock_halves == 2)
+    return samples;
+  for (i = 0; i < length && i < PF_SOUND_SAMPLES; i++)
+  {
+    u32 position;
+    int sum = 0, pieces = 0;
+
+    for (position = (u32)i << 16; position < (u32)PF_SOUND_SAMPLES << 16;
+         position += audio.end)
+    {
+      sum += samples[(position >> 16) * 2];
+      pieces++;
+    }
+    audio.folded[i * 2] = sum / pieces;
+  }
+
+  return audio.folded;
+}
+
+/**
+ * Converts one frame of input to the output rate with linear interpolation.
+ * The beeper output is the same on both channels, so only the left channel
+ * is interpolated and then duplicated. Returns the output sample count.
+ */
+static unsigned pfu_audio_resample(const short *samples)
+{
+  const u32 end = audio.end;
+  u32 phase = audio.phase;
+  short *dst = audio.output;
+  unsigned count = 0;
+
+  while (phase < end && count < PFU_AUDIO_MAX_SAMPLES)
+  {
+    unsigned index = phase >> 16;
+    int a = samples[index * 2];
+    int b = index + 1 < PF_SOUND_SAMPLES ? samples[(index + 1) * 2] : a;
+    /* A full-scale step times the fraction overflows 32 bits */
+    short value = a + (int)(((long long)(b - a) * (phase & 0xFFFF)) >> 16);
+
+    *dst++ = value;
+    *dst++ = value;
+    phase += audio.step;
+    count++;
+  }
+  audio.phase = phase - end;
+
+  return count;
+}
+
+/**
+ * Reduces one frame of input to the positions and sizes of its level
+ * changes. Returns the number of changes.
+ */
+static unsigned pfu_audio_find_events(const short *samples)
+{
+  const unsigned played = (audio.end + 0xFFFF) >> 16;
+  unsigned count = 0, i;
+  int level = audio.level;
+
+  for (i = 0; i < played && i < PF_SOUND_SAMPLES; i++)
+  {
+    if (samples[i * 2] != level)
+    {
+      audio.events[count].position = (u32)i << 16;
+      audio.events[count].delta = samples[i * 2] - level;
+      level = samples[i * 2];
+      count++;
+    }
+  }
+
+  return count;
+}
+
+/**
+ * Renders one frame at the output rate from its level changes. Flat runs
+ * between changes are filled first, then each edge is smoothed by adding
+ * the polyBLEP residual to the output samples on either side of it.
+ * Returns the output sample count, starting with the sample held back from
+ * the previous frame.
+ */
+static unsigned pfu_audio_synthesize(unsigned event_count)
+{
+  const u32 end = audio.end;
+  const u32 start = audio.phase;
+  short *frame = &audio.output[2];
+  u32 phase = start;
+  int level = audio.level;
+  unsigned count = 0, event = 0;
+
+  audio.output[0] = audio.held;
+  audio.output[1] = audio.held;
+  while (phase < end && count < PFU_AUDIO_MAX_SAMPLES)
+  {
+    while (event < event_count && audio.events[event].position <= phase)
+      level += audio.events[event++].delta;
+    frame[count * 2] = level;
+    frame[count * 2 + 1] = level;
+    phase += audio.step;
+    count++;
+  }
+  audio.phase = phase - end;
+  audio.level = level;
+  frame[0] += audio.carry;
+  frame[1] += audio.carry;
+  audio.carry = 0;
+
+  for (event = 0; event < event_count; event++)
+  {
+    const pfu_audio_event_t *e = &audio.events[event];
+    unsigned after = e->position > start ?
+      (e->position - start + audio.step - 1) / audio.step : 0;
+    u32 position = start + after * audio.step;
+    int half = e->delta / 2;
+    u32 f;
+    int residual;
+
+    /**
+     * First sample at or after the edge: -h/2 * (1 - f)^2. Past the last
+     * sample, it is the next frame's first.
+     */
+    f = 0x10000 - (u32)(((unsigned long long)(position - e->position) << 16) /
+                        audio.step);
+    residual = (int)(((long long)half * f * f) >> 32);
+    if (after < count)
+    {
+      frame[after * 2] -= residual;
+      frame[after * 2 + 1] -= residual;
+    }
+    else if (after == count)
+      audio.carry -= residual;
+
+    /**
+     * Last sample before the edge: +h/2 * (1 - f)^2. Before the first
+     * sample, it is the one held back from the previous frame.
+     */
+    f = 0x10000 - (u32)(((unsigned long long)(e->position -
+                        (position - audio.step)) << 16) / audio.step);
+    residual = (int)(((long long)half * f * f) >> 32);
+    if (after > 0)
+    {
+      frame[(after - 1) * 2] += residual;
+      frame[(after - 1) * 2 + 1] += residual;
+    }
+    else
+    {
+      audio.output[0] += residual;
+      audio.output[1] += residual;
+    }
+  }
+  audio.held = frame[(count - 1) * 2];
+
+  return count;
+}
+
+void pfu_audio_push(const short *samples)
+{
+  u32 start = get_ticks();
+  u32 resampled, pushed;
+
+  samples = pfu_audio_fold(samples);
+  if (audio.synth == PFU_AUDIO_SYNTH_BAND_LIMITED)
+  {
+    unsigned events = pfu_audio_find_events(samples);
+    unsigned count = pfu_audio_synthesize(events);
+
+    audio.stats.events = events;
+    resampled = get_ticks();
+    audio_push(audio.output, count, true);
+  }
+  else if (audio.stats.frequency == PF_SOUND_FREQUENCY &&
+           audio.overclock_halves == 2)
+  {
+    resampled = get_ticks();
+    audio_push(samples, PF_SOUND_SAMPLES, true);
+  }
+  else
+  {
+    unsigned count = pfu_audio_resample(samples);
+
+    resampled = get_ticks();
+    audio_push(audio.output, count, true);
+  }
+
+  /* audio_push blocks until a buffer is free, so its cost is mostly waiting */
+  pushed = get_ticks();
+  audio.resample_ticks += resampled - start;
+  audio.push_ticks += pushed - resampled;
+  pfu_stats_wait(pushed - resampled);
+  if (++audio.window_frames == PFU_AUDIO_WINDOW)
+  {
+    audio.stats.resample_us = TICKS_TO_US(audio.resample_ticks) / PFU_AUDIO_WINDOW;
+    audio.stats.push_us = TICKS_TO_US(audio.push_ticks) / PFU_AUDIO_WINDOW;
+    audio.resample_ticks = 0;
+    audio.push_ticks = 0;
+    audio.window_frames = 0;
+  }
+}
+
+const pfu_audio_stats_t *pfu_audio_stats(void)
+{
+  return &audio.stats;
+}
@@ -0,0 +1,66 @@
+#ifndef PRESS_F_ULTRA_AUDIO_H
+#define PRESS_F_ULTRA_AUDIO_H
+
+#include "libpressf/src/emu.h"
+
+typedef enum
+{
+  PFU_AUDIO_RATE_44100 = 0,
+  PFU_AUDIO_RATE_32000,
+  PFU_AUDIO_RATE_22050,
+
+  PFU_AUDIO_RATE_SIZE
+} pfu_audio_rate;
+
+typedef enum
+{
+  /* Beeper samples are output as produced by the core */
+  PFU_AUDIO_SYNTH_LEGACY = 0,
+
+  /**
+   * Beeper output is reduced to a list of level changes, then rendered in
+   * one pass with band-limited (polyBLEP) edges.
+   */
+  PFU_AUDIO_SYNTH_BAND_LIMITED,
+
+  PFU_AUDIO_SYNTH_SIZE
+} pfu_audio_synth;
+
+typedef struct
+{
+  /* Output rate actually in use, as reported by libdragon */
+  unsigned frequency;
+
+  /* Average cost per frame at the current rate, in microseconds */
+  unsigned resample_us;
+  unsigned push_us;
+
+  /* Level changes found in the last frame, in band-limited mode */
+  unsigned events;
+} pfu_audio_stats_t;
+
+/**
+ * Initializes audio output at one of the selectable rates, or changes the
+ * rate if audio is already running.
+ */
+void pfu_audio_init(pfu_audio_rate rate);
+
+void pfu_audio_set_synth(pfu_audio_synth synth);
+
+/**
+ * Sets the emulated CPU clock multiplier, in halves. The core fills a frame
+ * of beeper samples with that many halves of a normal frame of guest time,
+ * so only the part of each frame matching one frame of real time is played,
+ * keeping tones at their normal pitch.
+ */
+void pfu_audio_set_overclock(unsigned halves);
+
+/**
+ * Outputs one frame of beeper samples, which are produced by the core at
+ * PF_SOUND_FREQUENCY, converting them to the output rate if needed.
+ */
+void pfu_audio_push(const short *samples);
+
+const pfu_audio_stats_t *pfu_audio_stats(void);
+
+#endif
@@ -0,0 +1,428 @@
+#include <libdragon.h>
+#include <sys/stat.h>
+
+#include "bootcache.h"
+#include "gamedb.h"
+#include "main.h"
+#include "memory.h"
+#include "romcache.h"
+#include "state.h"
+#include "stats.h"
+#include "FastLZ/fastlz.h"
+
+#define PFU_BOOTCACHE_MAGIC 0x50464243 /* "PFBC" */
+#define PFU_BOOTCACHE_VERSION 2
+#define PFU_PATH_BOOTCACHE_TEMP PFU_PATH_BOOTCACHE "/write.tmp"
+
+/**
+ * Snapshots are compressed in chunks of this size, each on its own, so
+ * saving one to the SD Card can be spread over several frames.
+ */
+#define PFU_BOOTCACHE_CHUNK_SIZE 0x2000
+
+/* FastLZ may expand incompressible data by up to 5% */
+#define PFU_BOOTCACHE_CHUNK_MAX \
+  (PFU_BOOTCACHE_CHUNK_SIZE + PFU_BOOTCACHE_CHUNK_SIZE / 16 + 66)
+
+/* End of the BIOS in the F8 address space; cartridge code starts here */
+#define PFU_BOOTCACHE_BIOS_END 0x0800
+
+/**
+ * Everything a post-boot snapshot depends on. The BIOS hash covers the
+ * whole BIOS region, so a changed system font also invalidates it.
+ */
+typedef struct
+{
+  u32 bios_hash;
+  u32 rom_hash;
+  u32 clock_speed;
+} pfu_bootcache_key_t;
+
+/**
+ * Starts a snapshot file. Each chunk of the snapshot follows as its
+ * compressed size, then its compressed data.
+ */
+typedef struct
+{
+  u32 magic;
+  u16 version;
+  u16 reserved;
+  pfu_bootcache_key_t key;
+  u32 state_size;
+} pfu_bootcache_header_t;
+
+typedef enum
+{
+  PFU_BOOTCACHE_STATE_IDLE = 0,
+
+  PFU_BOOTCACHE_STATE_OPEN,
+  PFU_BOOTCACHE_STATE_WRITE,
+  PFU_BOOTCACHE_STATE_CLOSE,
+
+  PFU_BOOTCACHE_STATE_SIZE
+} pfu_bootcache_state;
+
+typedef struct
+{
+  pfu_bootcache_key_t key;
+  u8 *data;
+  unsigned size;
+  unsigned last_used;
+} pfu_bootcache_slot_t;
+
+typedef struct
+{
+  pfu_bootcache_slot_t slots[PFU_BOOTCACHE_SLOTS];
+  unsigned uses;
+  bool directory_ready;
+
+  /* Whether snapshots are also kept on the SD Card */
+  bool persist;
+
+  /* Snapshot being written to the SD Card, one chunk per step */
+  pfu_bootcache_state state;
+  const pfu_bootcache_slot_t *writing;
+  unsigned written;
+  u8 *chunk;
+  FILE *file;
+
+  /* The launch in progress */
+  pfu_bootcache_key_t key;
+  bool armed;
+  bool restored;
+  bool measuring;
+  unsigned frames;
+  u32 launch_start;
+} pfu_bootcache_t;
+
+static pfu_bootcache_t bootcache;
+
+static bool pfu_bootcache_key_equal(const pfu_bootcache_key_t *a,
+                                    const pfu_bootcache_key_t *b)
+{
+  return a->bios_hash == b->bios_hash && a->rom_hash == b->rom_hash &&
+         a->clock_speed == b->clock_speed;
+}
+
+static void pfu_bootcache_path(char *path, unsigned size,
+                               const pfu_bootcache_key_t *key)
+{
+  snprintf(path, size, "%s/%08lX.pfs", PFU_PATH_BOOTCACHE,
+           (unsigned long)pfu_crc32(0, key, sizeof(*key)));
+}
+
+static pfu_bootcache_slot_t *pfu_bootcache_find(const pfu_bootcache_key_t *key)
+{
+  unsigned i;
+
+  for (i = 0; i < PFU_BOOTCACHE_SLOTS; i++)
+    if (bootcache.slots[i].data &&
+        pfu_bootcache_key_equal(&bootcache.slots[i].key, key))
+      return &bootcache.slots[i];
+
+  return NULL;
+}
+
+/**
+ * Returns an empty slot, or the least recently used one, sized for a
+ * snapshot of the given size.
+ */
+static pfu_bootcache_slot_t *pfu_bootcache_alloc(unsigned size)
+{
+  pfu_bootcache_slot_t *slot = &bootcache.slots[0];
+  unsigned i;
+
+  for (i = 1; i < PFU_BOOTCACHE_SLOTS && slot->data; i++)
+    if (!bootcache.slots[i].data ||
+        bootcache.slots[i].last_used < slot->last_used)
+      slot = &bootcache.slots[i];
+
+  if (slot->data && slot->size != size)
+  {
+    pfu_free(slot->data);
+    slot->data = NULL;
+  }
+  if (!slot->data)
+    slot->data = pfu_malloc(PFU_MEMORY_STATE, size);
+  slot->size = slot->data ? size : 0;
+  slot->last_used = ++bootcache.uses;
+
+  return slot->data ? slot : NULL;
+}
+
+static void pfu_bootcache_cancel(void)
+{
+  if (bootcache.file)
+  {
+    fclose(bootcache.file);
+    remove(PFU_PATH_BOOTCACHE_TEMP);
+  }
+  bootcache.file = NULL;
+  if (bootcache.chunk)
+    pfu_free(bootcache.chunk);
+  bootcache.chunk = NULL;
+  bootcache.writing = NULL;
+  bootcache.state = PFU_BOOTCACHE_STATE_IDLE;
+}
+
+void pfu_bootcache_step(void)
+{
+  const pfu_bootcache_slot_t *slot = bootcache.writing;
+
+  switch (bootcache.state)
+  {
+  case PFU_BOOTCACHE_STATE_OPEN:
+  {
+    pfu_bootcache_header_t header;
+
+    if (!bootcache.directory_ready)
+    {
+      mkdir(PFU_PATH_BOOTCACHE, 0777);
+      bootcache.directory_ready = true;
+    }
+    header.magic = PFU_BOOTCACHE_MAGIC;
+    header.version = PFU_BOOTCACHE_VERSION;
+    header.reserved = 0;
+    header.key = slot->key;
+    header.state_size = slot->size;
+
+    /* Written aside and renamed, so a power cut never leaves half a file */
+    bootcache.chunk = pfu_malloc(PFU_MEMORY_STATE, PFU_BOOTCACHE_CHUNK_MAX);
+    bootcache.file = fopen(PFU_PATH_BOOTCACHE_TEMP, "wb");
+    if (!bootcache.chunk || !bootcache.file ||
+        fwrite(&header, sizeof(header), 1, bootcache.file) != 1)
+      pfu_bootcache_cancel();
+    else
+    {
+      bootcache.written = 0;
+      bootcache.state = PFU_BOOTCACHE_STATE_WRITE;
+    }
+    break;
+  }
+  case PFU_BOOTCACHE_STATE_WRITE:
+  {
+    unsigned size = slot->size - bootcache.written;
+    u32 compressed_size;
+
+    if (size > PFU_BOOTCACHE_CHUNK_SIZE)
+      size = PFU_BOOTCACHE_CHUNK_SIZE;
+    compressed_size = fastlz_compress_level(1, &slot->data[bootcache.written],
+                                            size, bootcache.chunk);
+    if (!compressed_size ||
+        fwrite(&compressed_size, sizeof(compressed_size), 1, bootcache.file) != 1 ||
+        fwrite(bootcache.chunk, 1, compressed_size, bootcache.file) != compressed_size)
+    {
+      pfu_bootcache_cancel();
+      break;
+    }
+    bootcache.written += size;
+    if (bootcache.written >= slot->size)
+      bootcache.state = PFU_BOOTCACHE_STATE_CLOSE;
+    break;
+  }
+  case PFU_BOOTCACHE_STATE_CLOSE:
+  {
+    char path[64];
+    bool closed = !fclose(bootcache.file);
+
+    bootcache.file = NULL;
+    pfu_bootcache_path(path, sizeof(path), &slot->key);
+    remove(path);
+    if (!closed || rename(PFU_PATH_BOOTCACHE_TEMP, path))
+      remove(PFU_PATH_BOOTCACHE_TEMP);
+    pfu_bootcache_cancel();
+    break;
+  }
+  default:
+    break;
+  }
+}
+
+static pfu_bootcache_slot_t *pfu_bootcache_read(const pfu_bootcache_key_t *key)
+{
+  pfu_bootcache_slot_t *slot = NULL;
+  pfu_bootcache_header_t header;
+  char path[64];
+  FILE *file;
+
+  pfu_bootcache_path(path, sizeof(path), key);
+  file = fopen(path, "rb");
+  if (!file)
+    return NULL;
+
+  if (fread(&header, sizeof(header), 1, file) == 1 &&
+      header.magic == PFU_BOOTCACHE_MAGIC &&
+      header.version == PFU_BOOTCACHE_VERSION &&
+      pfu_bootcache_key_equal(&header.key, key) &&
+      header.state_size == pfu_state_size())
+  {
+    u8 *compressed = pfu_malloc(PFU_MEMORY_STATE, PFU_BOOTCACHE_CHUNK_MAX);
+    unsigned read = 0;
+
+    slot = compressed ? pfu_bootcache_alloc(header.state_size) : NULL;
+    while (slot && read < slot->size)
+    {
+      unsigned size = slot->size - read;
+      u32 compressed_size;
+
+      if (size > PFU_BOOTCACHE_CHUNK_SIZE)
+        size = PFU_BOOTCACHE_CHUNK_SIZE;
+      if (fread(&compressed_size, sizeof(compressed_size), 1, file) != 1 ||
+          compressed_size > PFU_BOOTCACHE_CHUNK_MAX ||
+          fread(compressed, 1, compressed_size, file) != compressed_size ||
+          fastlz_decompress(compressed, compressed_size, &slot->data[read],
+                            size) != (int)size)
+      {
+        pfu_free(slot->data);
+        memset(slot, 0, sizeof(*slot));
+        slot = NULL;
+      }
+      else
+        read += size;
+    }
+    if (slot)
+      slot->key = *key;
+    pfu_free(compressed);
+  }
+  fclose(file);
+
+  return slot;
+}
+
+/**
+ * Fills a key with everything the state reached from a reset depends on,
+ * for the BIOS and ROM now loaded and the settings now in use.
+ */
+static void pfu_bootcache_current_key(pfu_bootcache_key_t *key)
+{
+  key->bios_hash = pfu_crc32(0, emu.system.memory, PFU_BOOTCACHE_BIOS_END);
+  key->rom_hash = frontend.rom_hash;
+  key->clock_speed = emu.system.settings.f3850_clock_speed;
+}
+
+void pfu_bootcache_set_persist(bool persist)
+{
+  bootcache.persist = persist;
+}
+
+void pfu_bootcache_launch(void)
+{
+  pfu_bootcache_slot_t *slot;
+
+  bootcache.launch_start = get_ticks();
+  bootcache.armed = false;
+  bootcache.restored = false;
+  bootcache.measuring = false;
+  bootcache.frames = 0;
+
+  /* Slots may be replaced below, including the one being written */
+  pfu_bootcache_cancel();
+
+  /* Booting to the BIOS alone has nothing to skip */
+  if (!frontend.rom_hash)
+    return;
+
+  pfu_bootcache_current_key(&bootcache.key);
+  bootcache.measuring = true;
+
+  slot = pfu_bootcache_find(&bootcache.key);
+  if (!slot)
+  {
+    /* Warm states of cached ROMs outlive the slots, with an Expansion Pak */
+    unsigned size;
+    const void *state = pfu_romcache_state(frontend.rom_hash,
+      pfu_crc32(0, &bootcache.key, sizeof(bootcache.key)), &size);
+
+    if (state && pfu_state_load(state, size))
+    {
+      bootcache.restored = true;
+      return;
+    }
+    else if (bootcache.persist)
+      slot = pfu_bootcache_read(&bootcache.key);
+  }
+  if (slot && pfu_state_load(slot->data, slot->size))
+  {
+    slot->last_used = ++bootcache.uses;
+    bootcache.restored = true;
+  }
+  else
+    bootcache.armed = true;
+}
+
+void pfu_bootcache_resume(void)
+{
+  pfu_bootcache_key_t key;
+
+  if (!bootcache.armed)
+    return;
+
+  /* Warm-up so far ran with the old settings, so its state is not reusable */
+  pfu_bootcache_current_key(&key);
+  if (!pfu_bootcache_key_equal(&key, &bootcache.key))
+  {
+    bootcache.armed = false;
+    bootcache.measuring = false;
+  }
+}
+
+/**
+ * Keeps the state now reached under the launch key, in RAM immediately and
+ * on the SD Card over the following frames.
+ */
+static void pfu_bootcache_store(void)
+{
+  unsigned size = pfu_state_size();
+  pfu_bootcache_slot_t *slot = pfu_bootcache_alloc(size);
+
+  if (!slot)
+    return;
+  else if (!pfu_state_save(slot->data, size))
+  {
+    pfu_free(slot->data);
+    memset(slot, 0, sizeof(*slot));
+    return;
+  }
+  slot->key = bootcache.key;
+  pfu_romcache_store_state(bootcache.key.rom_hash,
+    pfu_crc32(0, &bootcache.key, sizeof(bootcache.key)), slot->data, size);
+  if (bootcache.persist)
+  {
+    bootcache.writing = slot;
+    bootcache.state = PFU_BOOTCACHE_STATE_OPEN;
+  }
+}
+
+void pfu_bootcache_frame(bool input_active)
+{
+  if (!bootcache.measuring)
+    return;
+  else if (bootcache.restored)
+  {
+    pfu_stats_log("boot rom=%08lX cached first_frame_us=%lu",
+                  (unsigned long)bootcache.key.rom_hash,
+                  (unsigned long)TICKS_TO_US(get_ticks() - bootcache.launch_start));
+    bootcache.measuring = false;
+  }
+  else if (input_active || ++bootcache.frames > PFU_BOOTCACHE_MAX_FRAMES)
+  {
+    /**
+     * State now depends on input, or the BIOS never handed over to the
+     * cartridge, so it can't be reused.
+     */
+    bootcache.armed = false;
+    bootcache.measuring = false;
+  }
+  else if (emu.system.pc0 >= PFU_BOOTCACHE_BIOS_END)
+  {
+    /* The cartridge has taken control from the BIOS */
+    u32 elapsed = get_ticks() - bootcache.launch_start;
+
+    pfu_bootcache_store();
+    pfu_stats_log("boot rom=%08lX cold first_frame_us=%lu frames=%u",
+                  (unsigned long)bootcache.key.rom_hash,
+                  (unsigned long)TICKS_TO_US(elapsed), bootcache.frames);
+    bootcache.armed = false;
+    bootcache.measuring = false;
+  }
+}
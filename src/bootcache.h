@@ -0,0 +1,50 @@
+#ifndef PRESS_F_ULTRA_BOOTCACHE_H
+#define PRESS_F_ULTRA_BOOTCACHE_H
+
+#include "libpressf/src/emu.h"
+
+#define PFU_PATH_BOOTCACHE "sd:/press-f/cache"
+
+/* Number of snapshots kept in RAM */
+#define PFU_BOOTCACHE_SLOTS 4
+
+/**
+ * A ROM's state is cached at the end of the first frame that finishes in
+ * cartridge code rather than the BIOS, if no input was held until then.
+ * Any state reached without input depends only on the cache key, so it can
+ * be restored on later launches to skip the BIOS boot sequence. Launches
+ * where the BIOS keeps control for longer than this are not cached.
+ */
+#define PFU_BOOTCACHE_MAX_FRAMES 120
+
+/**
+ * Sets whether snapshots are also saved to and loaded from the SD Card, in
+ * addition to being kept in RAM.
+ */
+void pfu_bootcache_set_persist(bool persist);
+
+/**
+ * Called after a ROM is loaded and the system reset. Restores a cached
+ * snapshot matching the BIOS, ROM and system settings if there is one,
+ * otherwise arms the cache to take one.
+ */
+void pfu_bootcache_launch(void);
+
+/**
+ * Called after each emulated frame with whether any input was held.
+ */
+void pfu_bootcache_frame(bool input_active);
+
+/**
+ * Called when emulation resumes from a menu. A snapshot not yet taken is
+ * abandoned if the settings in its key were changed.
+ */
+void pfu_bootcache_resume(void);
+
+/**
+ * Compresses and writes a bounded slice of a pending snapshot to the SD
+ * Card. Called once per frame of the main loop.
+ */
+void pfu_bootcache_step(void);
+
+#endif
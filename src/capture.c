@@ -0,0 +1,356 @@
+#include <libdragon.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "libpressf/src/emu.h"
+#include "libpressf/src/screen.h"
+
+#include "capture.h"
+#include "gamedb.h"
+#include "main.h"
+#include "stats.h"
+
+/**
+ * Captures are written as 4-bit indexed PNG files. The Channel F only has
+ * eight colors, so the image data is small enough to store uncompressed,
+ * which lets encoding be split into cheap row-sized steps.
+ */
+#define PFU_CAPTURE_COLORS 16
+#define PFU_CAPTURE_ROW_SIZE (1 + (SCREEN_WIDTH + 1) / 2)
+#define PFU_CAPTURE_IMAGE_SIZE (PFU_CAPTURE_ROW_SIZE * SCREEN_HEIGHT)
+#define PFU_CAPTURE_PNG_SIZE (8 + (12 + 13) + (12 + PFU_CAPTURE_COLORS * 3) + \
+  (12 + 2 + 5 + PFU_CAPTURE_IMAGE_SIZE + 4) + 12)
+
+/* Work done in a single step, so a capture never takes a frame's budget */
+#define PFU_CAPTURE_ROWS_PER_STEP 16
+#define PFU_CAPTURE_BYTES_PER_STEP 1024
+
+/* Steps taken by one capture, from opening its file to logging it */
+#define PFU_CAPTURE_STEPS (1 + \
+  (SCREEN_HEIGHT + PFU_CAPTURE_ROWS_PER_STEP - 1) / PFU_CAPTURE_ROWS_PER_STEP + \
+  1 + (PFU_CAPTURE_PNG_SIZE + PFU_CAPTURE_BYTES_PER_STEP - 1) / \
+  PFU_CAPTURE_BYTES_PER_STEP + 1 + 1)
+
+typedef enum
+{
+  PFU_CAPTURE_STATE_IDLE = 0,
+
+  PFU_CAPTURE_STATE_SCAN,
+  PFU_CAPTURE_STATE_OPEN,
+  PFU_CAPTURE_STATE_ENCODE,
+  PFU_CAPTURE_STATE_BUILD,
+  PFU_CAPTURE_STATE_WRITE,
+  PFU_CAPTURE_STATE_CLOSE,
+  PFU_CAPTURE_STATE_LOG,
+
+  PFU_CAPTURE_STATE_SIZE
+} pfu_capture_state;
+
+typedef struct
+{
+  u16 frame[SCREEN_WIDTH * SCREEN_HEIGHT];
+  u8 image[PFU_CAPTURE_IMAGE_SIZE];
+  u8 png[PFU_CAPTURE_PNG_SIZE];
+  u16 palette[PFU_CAPTURE_COLORS];
+  unsigned palette_size;
+
+  pfu_capture_state state;
+  FILE *file;
+  char path[64];
+  bool scanned;
+  unsigned next_index;
+  unsigned row;
+  unsigned png_size;
+  unsigned written;
+
+  /* errno of the first failure of the capture in progress, or 0 */
+  int error;
+
+  bool requested;
+  unsigned interval;
+  unsigned counter;
+
+  /* Statistics for the capture in progress */
+  unsigned frame_number;
+  unsigned steps;
+  unsigned dropped_start;
+  unsigned skipped;
+} pfu_capture_t;
+
+static pfu_capture_t capture;
+
+void pfu_capture_request(void)
+{
+  capture.requested = true;
+}
+
+unsigned pfu_capture_min_interval(void)
+{
+  return PFU_CAPTURE_STEPS;
+}
+
+void pfu_capture_set_interval(unsigned interval)
+{
+  capture.interval = interval;
+  capture.counter = 0;
+}
+
+void pfu_capture_frame(void)
+{
+  bool due = capture.requested;
+
+  if (capture.interval && ++capture.counter >= capture.interval)
+  {
+    capture.counter = 0;
+    due = true;
+  }
+  if (!due)
+    return;
+  else if (capture.state != PFU_CAPTURE_STATE_IDLE)
+  {
+    /* Single requests stay pending; dumped frames are skipped */
+    if (!capture.requested)
+      capture.skipped++;
+    return;
+  }
+
+  memcpy(capture.frame, emu.video_buffer, sizeof(capture.frame));
+  capture.requested = false;
+  capture.palette_size = 0;
+  capture.row = 0;
+  capture.written = 0;
+  capture.error = 0;
+  capture.frame_number = emu.frames;
+  capture.steps = 0;
+  capture.dropped_start = pfu_stats.dropped_frames;
+  capture.state = capture.scanned ?
+    PFU_CAPTURE_STATE_OPEN : PFU_CAPTURE_STATE_SCAN;
+}
+
+/**
+ * Finds the highest existing capture number so earlier captures are not
+ * overwritten, creating the directory if needed. Done once per boot.
+ */
+static void pfu_capture_scan(void)
+{
+  dir_t dir;
+  int err = dir_findfirst(PFU_PATH_CAPTURES, &dir);
+
+  if (err)
+    mkdir(PFU_PATH_CAPTURES, 0777);
+  while (!err)
+  {
+    unsigned index;
+
+    if (sscanf(dir.d_name, "pf_%05u.png", &index) == 1 &&
+        index >= capture.next_index)
+      capture.next_index = index + 1;
+    err = dir_findnext(PFU_PATH_CAPTURES, &dir);
+  }
+  capture.scanned = true;
+}
+
+static unsigned pfu_capture_color_index(u16 color)
+{
+  unsigned i;
+
+  for (i = 0; i < capture.palette_size; i++)
+    if (capture.palette[i] == color)
+      return i;
+  if (capture.palette_size < PFU_CAPTURE_COLORS)
+  {
+    capture.palette[capture.palette_size] = color;
+    return capture.palette_size++;
+  }
+
+  return 0;
+}
+
+static void pfu_capture_encode_row(unsigned y)
+{
+  const u16 *src = &capture.frame[y * SCREEN_WIDTH];
+  u8 *dst = &capture.image[y * PFU_CAPTURE_ROW_SIZE];
+  unsigned x;
+
+  /* Filter type: none */
+  *dst++ = 0;
+  for (x = 0; x < SCREEN_WIDTH; x += 2)
+  {
+    u8 pixels = pfu_capture_color_index(src[x]) << 4;
+
+    if (x + 1 < SCREEN_WIDTH)
+      pixels |= pfu_capture_color_index(src[x + 1]);
+    *dst++ = pixels;
+  }
+}
+
+static u8 *pfu_capture_put_u32(u8 *dst, u32 value)
+{
+  dst[0] = (value >> 24) & 0xFF;
+  dst[1] = (value >> 16) & 0xFF;
+  dst[2] = (value >> 8) & 0xFF;
+  dst[3] = value & 0xFF;
+
+  return dst + 4;
+}
+
+/**
+ * Writes a PNG chunk around data already placed after its 8-byte header.
+ */
+static u8 *pfu_capture_put_chunk(u8 *dst, const char *type, unsigned size)
+{
+  pfu_capture_put_u32(dst, size);
+  memcpy(dst + 4, type, 4);
+  pfu_capture_put_u32(dst + 8 + size, pfu_crc32(0, dst + 4, size + 4));
+
+  return dst + 12 + size;
+}
+
+static void pfu_capture_build(void)
+{
+  static const u8 signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+  u8 *dst = capture.png;
+  u8 *data;
+  u32 adler_a = 1, adler_b = 0;
+  unsigned i;
+
+  memcpy(dst, signature, sizeof(signature));
+  dst += sizeof(signature);
+
+  /* Header: 4-bit indexed color */
+  data = pfu_capture_put_u32(dst + 8, SCREEN_WIDTH);
+  data = pfu_capture_put_u32(data, SCREEN_HEIGHT);
+  data[0] = 4;
+  data[1] = 3;
+  data[2] = 0;
+  data[3] = 0;
+  data[4] = 0;
+  dst = pfu_capture_put_chunk(dst, "IHDR", 13);
+
+  /* Palette, expanded from RGBA5551 */
+  data = dst + 8;
+  for (i = 0; i < capture.palette_size; i++)
+  {
+    u16 color = capture.palette[i];
+    u8 r = (color >> 11) & 0x1F;
+    u8 g = (color >> 6) & 0x1F;
+    u8 b = (color >> 1) & 0x1F;
+
+    *data++ = (r << 3) | (r >> 2);
+    *data++ = (g << 3) | (g >> 2);
+    *data++ = (b << 3) | (b >> 2);
+  }
+  dst = pfu_capture_put_chunk(dst, "PLTE", capture.palette_size * 3);
+
+  /* Image data as a zlib stream holding one stored deflate block */
+  data = dst + 8;
+  *data++ = 0x78;
+  *data++ = 0x01;
+  *data++ = 0x01;
+  *data++ = PFU_CAPTURE_IMAGE_SIZE & 0xFF;
+  *data++ = (PFU_CAPTURE_IMAGE_SIZE >> 8) & 0xFF;
+  *data++ = ~PFU_CAPTURE_IMAGE_SIZE & 0xFF;
+  *data++ = (~PFU_CAPTURE_IMAGE_SIZE >> 8) & 0xFF;
+  memcpy(data, capture.image, PFU_CAPTURE_IMAGE_SIZE);
+  for (i = 0; i < PFU_CAPTURE_IMAGE_SIZE; i++)
+  {
+    adler_a = (adler_a + capture.image[i]) % 65521;
+    adler_b = (adler_b + adler_a) % 65521;
+  }
+  pfu_capture_put_u32(data + PFU_CAPTURE_IMAGE_SIZE, (adler_b << 16) | adler_a);
+  dst = pfu_capture_put_chunk(dst, "IDAT", 2 + 5 + PFU_CAPTURE_IMAGE_SIZE + 4);
+
+  dst = pfu_capture_put_chunk(dst, "IEND", 0);
+  capture.png_size = dst - capture.png;
+}
+
+static void pfu_capture_log(void)
+{
+  FILE *file = fopen(PFU_PATH_CAPTURES "/captures.txt", "a");
+
+  if (file)
+  {
+    if (capture.error)
+      fprintf(file, "%s failed frame=%u error=%s\n",
+              capture.path, capture.frame_number, strerror(capture.error));
+    else
+      fprintf(file, "%s frame=%u steps=%u dropped=%u skipped=%u\n",
+              capture.path, capture.frame_number, capture.steps,
+              pfu_stats.dropped_frames - capture.dropped_start,
+              capture.skipped);
+    fclose(file);
+  }
+  capture.skipped = 0;
+}
+
+void pfu_capture_step(void)
+{
+  unsigned i;
+
+  if (capture.state == PFU_CAPTURE_STATE_IDLE)
+    return;
+  capture.steps++;
+
+  switch (capture.state)
+  {
+  case PFU_CAPTURE_STATE_SCAN:
+    pfu_capture_scan();
+    capture.state = PFU_CAPTURE_STATE_OPEN;
+    break;
+  case PFU_CAPTURE_STATE_OPEN:
+    snprintf(capture.path, sizeof(capture.path), "%s/pf_%05u.png",
+             PFU_PATH_CAPTURES, capture.next_index++);
+    capture.file = fopen(capture.path, "wb");
+    if (capture.file)
+      capture.state = PFU_CAPTURE_STATE_ENCODE;
+    else
+    {
+      capture.error = errno;
+      capture.state = PFU_CAPTURE_STATE_LOG;
+    }
+    break;
+  case PFU_CAPTURE_STATE_ENCODE:
+    for (i = 0; i < PFU_CAPTURE_ROWS_PER_STEP && capture.row < SCREEN_HEIGHT; i++)
+      pfu_capture_encode_row(capture.row++);
+    if (capture.row == SCREEN_HEIGHT)
+      capture.state = PFU_CAPTURE_STATE_BUILD;
+    break;
+  case PFU_CAPTURE_STATE_BUILD:
+    pfu_capture_build();
+    capture.state = PFU_CAPTURE_STATE_WRITE;
+    break;
+  case PFU_CAPTURE_STATE_WRITE:
+  {
+    unsigned size = capture.png_size - capture.written;
+
+    if (size > PFU_CAPTURE_BYTES_PER_STEP)
+      size = PFU_CAPTURE_BYTES_PER_STEP;
+    if (fwrite(&capture.png[capture.written], 1, size, capture.file) != size)
+    {
+      capture.error = errno ? errno : EIO;
+      capture.state = PFU_CAPTURE_STATE_CLOSE;
+      break;
+    }
+    capture.written += size;
+    if (capture.written == capture.png_size)
+      capture.state = PFU_CAPTURE_STATE_CLOSE;
+    break;
+  }
+  case PFU_CAPTURE_STATE_CLOSE:
+    if (fclose(capture.file) && !capture.error)
+      capture.error = errno ? errno : EIO;
+    capture.file = NULL;
+
+    /* Don't leave a truncated image behind */
+    if (capture.error)
+      remove(capture.path);
+    capture.state = PFU_CAPTURE_STATE_LOG;
+    break;
+  case PFU_CAPTURE_STATE_LOG:
+    pfu_capture_log();
+    capture.state = PFU_CAPTURE_STATE_IDLE;
+    break;
+  default:
+    capture.state = PFU_CAPTURE_STATE_IDLE;
+  }
+}
@@ -0,0 +1,35 @@
+#ifndef PRESS_F_ULTRA_CAPTURE_H
+#define PRESS_F_ULTRA_CAPTURE_H
+
+#define PFU_PATH_CAPTURES "sd:/press-f/captures"
+
+/**
+ * Requests a screenshot of the next emulated frame.
+ */
+void pfu_capture_request(void);
+
+/**
+ * Returns the fewest frames between dumped frames. Each capture is spread
+ * over this many frames, so a shorter interval would skip frames.
+ */
+unsigned pfu_capture_min_interval(void);
+
+/**
+ * Sets the frame dump interval. Every Nth emulated frame is captured, or
+ * none if the interval is 0.
+ */
+void pfu_capture_set_interval(unsigned interval);
+
+/**
+ * Called after each emulated frame is drawn. Copies the frame aside if a
+ * capture is due; all encoding and writing is deferred to pfu_capture_step.
+ */
+void pfu_capture_frame(void);
+
+/**
+ * Performs a bounded slice of pending capture work. Called once per frame
+ * of the main loop so a capture is spread over several frames.
+ */
+void pfu_capture_step(void);
+
+#endif
@@ -0,0 +1,159 @@
+#include <libdragon.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "config.h"
+#include "gamedb.h"
+
+/* Bytes written to EEPROM at once */
+#define PFU_CONFIG_BLOCK_SIZE 8
+
+/**
+ * The stored record. Its size is a multiple of the EEPROM block size, and
+ * is stored in it so later versions can tell how much was written.
+ */
+typedef struct
+{
+  u32 magic;
+  u16 version;
+  u16 size;
+  signed char settings[PFU_CONFIG_SETTINGS];
+  u8 rom_source;
+  u8 reserved[3];
+  char rom_name[96];
+  u32 crc;
+} pfu_config_record_t;
+
+typedef struct
+{
+  /* The record as changed in memory, and as last read or written */
+  pfu_config_record_t record;
+  pfu_config_record_t stored;
+
+  bool eeprom;
+  bool loaded;
+
+  /* Whether every block must be written, as the stored record is invalid */
+  bool rewrite;
+} pfu_config_t;
+
+static pfu_config_t config;
+
+static u32 pfu_config_crc(const pfu_config_record_t *record)
+{
+  return pfu_crc32(0, record, offsetof(pfu_config_record_t, crc));
+}
+
+static void pfu_config_defaults(pfu_config_record_t *record)
+{
+  memset(record, 0, sizeof(*record));
+  record->magic = PFU_CONFIG_MAGIC;
+  record->version = PFU_CONFIG_VERSION;
+  record->size = sizeof(*record);
+  record->crc = pfu_config_crc(record);
+}
+
+void pfu_config_load(void)
+{
+  pfu_config_record_t *record = &config.record;
+  bool read = false;
+
+  config.eeprom = eeprom_present() != EEPROM_NONE;
+  if (config.eeprom)
+  {
+    eeprom_read_bytes((u8*)record, 0, sizeof(*record));
+    read = true;
+  }
+  else
+  {
+    FILE *file = fopen(PFU_PATH_CONFIG, "rb");
+
+    if (file)
+    {
+      read = fread(record, sizeof(*record), 1, file) == 1;
+      fclose(file);
+    }
+  }
+
+  if (!read || record->magic != PFU_CONFIG_MAGIC ||
+      record->version != PFU_CONFIG_VERSION ||
+      record->size != sizeof(*record) ||
+      record->crc != pfu_config_crc(record))
+  {
+    pfu_config_defaults(record);
+    memset(&config.stored, 0, sizeof(config.stored));
+    config.rewrite = true;
+  }
+  else
+    config.stored = *record;
+  record->rom_name[sizeof(record->rom_name) - 1] = '\0';
+  config.loaded = true;
+}
+
+signed pfu_config_setting(unsigned key)
+{
+  return key < PFU_CONFIG_SETTINGS ? config.record.settings[key] : 0;
+}
+
+void pfu_config_set_setting(unsigned key, signed value)
+{
+  if (key < PFU_CONFIG_SETTINGS)
+    config.record.settings[key] = value;
+}
+
+const char *pfu_config_rom(unsigned *source)
+{
+  if (!config.record.rom_source || !config.record.rom_name[0])
+    return NULL;
+  *source = config.record.rom_source;
+
+  return config.record.rom_name;
+}
+
+void pfu_config_set_rom(const char *name, unsigned source)
+{
+  if (name && strlen(name) < sizeof(config.record.rom_name))
+  {
+    snprintf(config.record.rom_name, sizeof(config.record.rom_name), "%s", name);
+    config.record.rom_source = source;
+  }
+  else
+  {
+    memset(config.record.rom_name, 0, sizeof(config.record.rom_name));
+    config.record.rom_source = 0;
+  }
+}
+
+void pfu_config_flush(void)
+{
+  pfu_config_record_t *record = &config.record;
+
+  if (!config.loaded)
+    return;
+  record->crc = pfu_config_crc(record);
+  if (!memcmp(record, &config.stored, sizeof(*record)))
+    return;
+
+  if (config.eeprom)
+  {
+    const u8 *src = (const u8*)record;
+    const u8 *old = (const u8*)&config.stored;
+    unsigned i;
+
+    for (i = 0; i < sizeof(*record); i += PFU_CONFIG_BLOCK_SIZE)
+      if (config.rewrite || memcmp(&src[i], &old[i], PFU_CONFIG_BLOCK_SIZE))
+        eeprom_write_bytes(&src[i], i, PFU_CONFIG_BLOCK_SIZE);
+  }
+  else
+  {
+    FILE *file = fopen(PFU_PATH_CONFIG, "wb");
+
+    if (!file)
+      return;
+    fwrite(record, sizeof(*record), 1, file);
+    fclose(file);
+  }
+  config.stored = *record;
+  config.rewrite = false;
+}
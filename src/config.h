@@ -0,0 +1,49 @@
+#ifndef PRESS_F_ULTRA_CONFIG_H
+#define PRESS_F_ULTRA_CONFIG_H
+
+#include "libpressf/src/emu.h"
+
+/**
+ * Persistent settings, kept as one small versioned record with a CRC32.
+ * The record is stored in cartridge EEPROM if there is one, otherwise on
+ * the SD Card.
+ */
+#define PFU_PATH_CONFIG "sd:/press-f/settings.bin"
+#define PFU_CONFIG_MAGIC 0x50464346 /* "PFCF" */
+#define PFU_CONFIG_VERSION 1
+
+/* Settings slots in the record, indexed by pfu_entry_key */
+#define PFU_CONFIG_SETTINGS 16
+
+/**
+ * Reads the record with a single read. Values default to 0 if it is
+ * missing, from another version, or fails its checksum.
+ */
+void pfu_config_load(void);
+
+/**
+ * Returns a stored setting value.
+ */
+signed pfu_config_setting(unsigned key);
+
+/**
+ * Changes a stored setting value. Nothing is written until
+ * pfu_config_flush, and only if a value differs from the stored record.
+ */
+void pfu_config_set_setting(unsigned key, signed value);
+
+/**
+ * Returns the name of the last loaded ROM and stores its source, or NULL
+ * if none was recorded.
+ */
+const char *pfu_config_rom(unsigned *source);
+
+void pfu_config_set_rom(const char *name, unsigned source);
+
+/**
+ * Writes the record if it changed since it was last read or written. With
+ * EEPROM, only the changed blocks are written.
+ */
+void pfu_config_flush(void);
+
+#endif
@@ -0,0 +1,441 @@
+#include <libdragon.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "cpak.h"
+#include "gamedb.h"
+#include "memory.h"
+#include "FastLZ/fastlz.h"
+
+#define PFU_CPAK_MOUNT "cpak1:/"
+#define PFU_CPAK_MAGIC 0xF8D1
+#define PFU_CPAK_MAGIC_HASHED 0xF8D0
+#define PFU_CPAK_MAGIC_LEGACY 0xF8CF
+#define PFU_CPAK_PAGE_SIZE 256
+#define PFU_CPAK_NAME_SIZE 32
+
+/**
+ * Starts the first note of a saved ROM. The compressed data follows, and
+ * continues in part notes if compressed_size is larger than the first note.
+ * compressed_size is 32-bit, as incompressible ROMs grow past 0xFFFF.
+ */
+typedef struct
+{
+  u16 magic;
+  u16 original_size;
+  u32 compressed_size;
+
+  /**
+   * CRC32 of the original ROM, taken when it was saved so loading does not
+   * need another pass over it.
+   */
+  u32 hash;
+} pfu_cpak_header_t;
+
+/**
+ * The header of notes saved before compressed_size was widened. Those with
+ * PFU_CPAK_MAGIC_LEGACY end before reserved and have no hash.
+ */
+typedef struct
+{
+  u16 compressed_size;
+  u16 reserved;
+  u32 hash;
+} pfu_cpak_header_old_t;
+
+#define PFU_CPAK_HEADER_COMMON_SIZE 4
+
+/* Largest FastLZ output for a given input; it may expand data by up to 5% */
+#define PFU_CPAK_COMPRESS_BOUND(size) ((unsigned)(size) + (size) / 16 + 66)
+
+typedef struct
+{
+  /* Whether a pak was inserted at the last poll */
+  bool present;
+
+  bool mounted;
+  bool formatted;
+
+  bool stats_valid;
+  cpakfs_stats_t stats;
+
+  bool list_valid;
+  unsigned rom_count;
+  char roms[PFU_CPAK_MAX_ROMS][PFU_CPAK_NAME_SIZE];
+} pfu_cpak_t;
+
+static pfu_cpak_t cpak;
+
+/**
+ * Ends the mount session and forgets everything cached from it.
+ */
+static void pfu_cpak_drop(void)
+{
+  if (cpak.mounted)
+    cpakfs_unmount(JOYPAD_PORT_1);
+  cpak.mounted = false;
+  cpak.formatted = false;
+  cpak.stats_valid = false;
+  cpak.list_valid = false;
+  cpak.rom_count = 0;
+}
+
+bool pfu_cpak_poll(void)
+{
+  bool present = joypad_get_accessory_type(JOYPAD_PORT_1) ==
+                   JOYPAD_ACCESSORY_TYPE_CONTROLLER_PAK;
+
+  if (present == cpak.present)
+    return false;
+  pfu_cpak_drop();
+  cpak.present = present;
+
+  return true;
+}
+
+bool pfu_cpak_mount(void)
+{
+  if (!cpak.mounted)
+  {
+    if (cpakfs_mount(JOYPAD_PORT_1, PFU_CPAK_MOUNT))
+      return false;
+    cpak.mounted = true;
+    cpak.formatted = !cpakfs_fsck(JOYPAD_PORT_1, false, NULL);
+  }
+
+  return true;
+}
+
+/**
+ * Opens a note, remounting once if that fails in case the pak was swapped
+ * between polls.
+ */
+static FILE *pfu_cpak_open(const char *path, const char *mode)
+{
+  FILE *file = fopen(path, mode);
+
+  if (!file && cpak.mounted)
+  {
+    pfu_cpak_drop();
+    if (pfu_cpak_mount())
+      file = fopen(path, mode);
+  }
+
+  return file;
+}
+
+/**
+ * Returns the path of one note of a saved ROM. Part 0 is the .CHF note.
+ */
+static void pfu_cpak_path(char *path, unsigned size, const char *name,
+                          unsigned part)
+{
+  const char *extension = strrchr(name, '.');
+  int length = extension ? (int)(extension - name) : (int)strlen(name);
+
+  if (part)
+    snprintf(path, size, "%s/%.*s.CH%u", PFU_PATH_CONTROLLER_PAK, length,
+             name, part);
+  else
+    snprintf(path, size, "%s/%.*s.CHF", PFU_PATH_CONTROLLER_PAK, length,
+             name);
+}
+
+const cpakfs_stats_t *pfu_cpak_stats(void)
+{
+  if (!pfu_cpak_mount())
+    return NULL;
+  else if (!cpak.stats_valid)
+    cpak.stats_valid = !cpakfs_get_stats(JOYPAD_PORT_1, &cpak.stats);
+
+  return cpak.stats_valid ? &cpak.stats : NULL;
+}
+
+/**
+ * Returns the pages and notes taken by a ROM already saved under a name, so
+ * that overwriting it only needs the difference.
+ */
+static void pfu_cpak_usage(const char *name, unsigned *pages, unsigned *notes)
+{
+  char path[64];
+  unsigned part;
+
+  *pages = 0;
+  *notes = 0;
+  for (part = 0; ; part++)
+  {
+    FILE *file;
+    long size;
+
+    pfu_cpak_path(path, sizeof(path), name, part);
+    file = fopen(path, "rb");
+    if (!file)
+      break;
+    size = fseek(file, 0, SEEK_END) ? -1 : ftell(file);
+    fclose(file);
+    if (size < 0)
+      break;
+    *pages += (size + PFU_CPAK_PAGE_SIZE - 1) / PFU_CPAK_PAGE_SIZE;
+    (*notes)++;
+  }
+}
+
+/**
+ * Reads the header of a saved ROM in any of its versions. hashed receives
+ * whether it holds the ROM's CRC32.
+ */
+static bool pfu_cpak_read_header(FILE *file, pfu_cpak_header_t *header,
+                                 bool *hashed)
+{
+  pfu_cpak_header_old_t old;
+
+  if (fread(header, PFU_CPAK_HEADER_COMMON_SIZE, 1, file) != 1)
+    return false;
+  switch (header->magic)
+  {
+  case PFU_CPAK_MAGIC:
+    *hashed = true;
+    return fread(&header->compressed_size,
+                 sizeof(*header) - PFU_CPAK_HEADER_COMMON_SIZE, 1, file) == 1;
+  case PFU_CPAK_MAGIC_HASHED:
+  case PFU_CPAK_MAGIC_LEGACY:
+    *hashed = header->magic == PFU_CPAK_MAGIC_HASHED;
+    if (fread(&old, *hashed ? sizeof(old) : sizeof(old.compressed_size),
+              1, file) != 1)
+      return false;
+    header->compressed_size = old.compressed_size;
+    header->hash = old.hash;
+    return true;
+  default:
+    return false;
+  }
+}
+
+static void pfu_cpak_scan(void)
+{
+  dir_t dir;
+  int err;
+
+  cpak.rom_count = 0;
+  for (err = dir_findfirst(PFU_CPAK_MOUNT, &dir);
+       !err && cpak.rom_count < PFU_CPAK_MAX_ROMS;
+       err = dir_findnext(PFU_CPAK_MOUNT, &dir))
+  {
+    const char *basename = strrchr(dir.d_name, '/');
+
+    basename = basename ? basename + 1 : dir.d_name;
+    if (dir.d_type == DT_REG && basename[0] != '.' && strstr(basename, ".CHF"))
+    {
+      snprintf(cpak.roms[cpak.rom_count], PFU_CPAK_NAME_SIZE, "%s", basename);
+      cpak.rom_count++;
+    }
+  }
+  cpak.list_valid = true;
+}
+
+unsigned pfu_cpak_rom_count(void)
+{
+  if (!pfu_cpak_mount())
+    return 0;
+  else if (!cpak.list_valid)
+    pfu_cpak_scan();
+
+  return cpak.rom_count;
+}
+
+const char *pfu_cpak_rom_name(unsigned index)
+{
+  return index < cpak.rom_count ? cpak.roms[index] : NULL;
+}
+
+pfu_cpak_error pfu_cpak_load(const char *name, void *dst, unsigned *size,
+                             u32 *hash)
+{
+  pfu_cpak_error error = PFU_CPAK_OK;
+  pfu_cpak_header_t header;
+  char path[64];
+  unsigned bytes_read, part;
+  u8 *compressed;
+  FILE *file;
+  int decompressed_size;
+  bool hashed;
+
+  if (!pfu_cpak_mount())
+    return PFU_CPAK_ERROR_NO_PAK;
+  pfu_cpak_path(path, sizeof(path), name, 0);
+  file = pfu_cpak_open(path, "rb");
+  if (!file)
+    return PFU_CPAK_ERROR_OPEN;
+  if (!pfu_cpak_read_header(file, &header, &hashed) ||
+      header.original_size > *size ||
+      header.compressed_size > PFU_CPAK_COMPRESS_BOUND(header.original_size))
+  {
+    fclose(file);
+    return PFU_CPAK_ERROR_FORMAT;
+  }
+
+  compressed = pfu_malloc(PFU_MEMORY_LOADER, header.compressed_size);
+  if (!compressed)
+  {
+    fclose(file);
+    return PFU_CPAK_ERROR_MEMORY;
+  }
+
+  /* Read the compressed data from the first note, then any part notes */
+  bytes_read = fread(compressed, 1, header.compressed_size, file);
+  fclose(file);
+  for (part = 1; bytes_read < header.compressed_size; part++)
+  {
+    unsigned chunk_read;
+
+    pfu_cpak_path(path, sizeof(path), name, part);
+    file = pfu_cpak_open(path, "rb");
+    if (!file)
+    {
+      error = PFU_CPAK_ERROR_IO;
+      break;
+    }
+    chunk_read = fread(&compressed[bytes_read], 1,
+                       header.compressed_size - bytes_read, file);
+    fclose(file);
+    if (!chunk_read)
+    {
+      error = PFU_CPAK_ERROR_IO;
+      break;
+    }
+    bytes_read += chunk_read;
+  }
+
+  if (!error)
+  {
+    /* Decompressed straight into place. Only legacy notes are hashed here */
+    decompressed_size = fastlz_decompress(compressed, header.compressed_size,
+                                          dst, header.original_size);
+    if (decompressed_size != header.original_size)
+      error = PFU_CPAK_ERROR_FORMAT;
+    else
+    {
+      *size = decompressed_size;
+      if (hash)
+        *hash = hashed ? header.hash : pfu_crc32(0, dst, decompressed_size);
+    }
+  }
+  pfu_free(compressed);
+
+  return error;
+}
+
+pfu_cpak_error pfu_cpak_save(const char *name, const void *data,
+                             unsigned size, unsigned *pages, unsigned *notes)
+{
+  pfu_cpak_error error = PFU_CPAK_OK;
+  const cpakfs_stats_t *stats;
+  pfu_cpak_header_t header;
+  unsigned total, written = 0, old_pages, old_notes, part, i;
+  char path[64];
+  u8 *compressed;
+
+  *pages = 0;
+  *notes = 0;
+  if (!pfu_cpak_mount())
+    return PFU_CPAK_ERROR_NO_PAK;
+  else if (!cpak.formatted)
+    return PFU_CPAK_ERROR_UNFORMATTED;
+
+  compressed = pfu_malloc(PFU_MEMORY_LOADER, PFU_CPAK_COMPRESS_BOUND(size));
+  if (!compressed)
+    return PFU_CPAK_ERROR_MEMORY;
+  header.magic = PFU_CPAK_MAGIC;
+  header.original_size = size;
+  header.hash = pfu_crc32(0, data, size);
+  header.compressed_size = fastlz_compress_level(2, data, size, compressed);
+  if (!header.compressed_size)
+  {
+    pfu_free(compressed);
+    return PFU_CPAK_ERROR_COMPRESS;
+  }
+
+  /* Work out the space needed across notes */
+  total = sizeof(header) + header.compressed_size;
+  for (i = 0; i < total; i += PFU_CPAK_NOTE_SIZE)
+  {
+    unsigned note_size = total - i < PFU_CPAK_NOTE_SIZE ?
+                           total - i : PFU_CPAK_NOTE_SIZE;
+
+    *pages += (note_size + PFU_CPAK_PAGE_SIZE - 1) / PFU_CPAK_PAGE_SIZE;
+    (*notes)++;
+  }
+
+  /* A ROM saved under the same name is replaced, freeing its notes */
+  stats = pfu_cpak_stats();
+  pfu_cpak_usage(name, &old_pages, &old_notes);
+  if (!stats ||
+      stats->pages.used - (int)old_pages + (int)*pages > stats->pages.total ||
+      stats->notes.used - (int)old_notes + (int)*notes > stats->notes.total)
+  {
+    pfu_free(compressed);
+    return PFU_CPAK_ERROR_NO_SPACE;
+  }
+
+  /* Write the header and data, splitting them across notes */
+  for (part = 0; part < *notes && !error; part++)
+  {
+    unsigned note_size = PFU_CPAK_NOTE_SIZE, data_size;
+    FILE *file;
+
+    pfu_cpak_path(path, sizeof(path), name, part);
+    file = pfu_cpak_open(path, "wb");
+    if (!file)
+    {
+      error = PFU_CPAK_ERROR_OPEN;
+      break;
+    }
+    if (!part)
+    {
+      if (fwrite(&header, sizeof(header), 1, file) != 1)
+        error = PFU_CPAK_ERROR_IO;
+      note_size -= sizeof(header);
+    }
+    data_size = header.compressed_size - written < note_size ?
+                  header.compressed_size - written : note_size;
+    if (!error && fwrite(&compressed[written], 1, data_size, file) != data_size)
+      error = PFU_CPAK_ERROR_IO;
+    written += data_size;
+    fclose(file);
+  }
+  pfu_free(compressed);
+
+  /* Notes written so far are removed rather than left incomplete */
+  if (error)
+  {
+    for (i = 0; i <= part && i < *notes; i++)
+    {
+      pfu_cpak_path(path, sizeof(path), name, i);
+      remove(path);
+    }
+    pfu_cpak_drop();
+    return error;
+  }
+
+  /* Part notes left over from a larger ROM saved under the same name */
+  for (part = *notes; ; part++)
+  {
+    pfu_cpak_path(path, sizeof(path), name, part);
+    if (remove(path))
+      break;
+  }
+
+  /* Keep the caches current without asking the pak again */
+  cpak.stats.pages.used += (int)*pages - (int)old_pages;
+  cpak.stats.notes.used += (int)*notes - (int)old_notes;
+  pfu_cpak_path(path, sizeof(path), name, 0);
+  name = strrchr(path, '/') + 1;
+  for (i = 0; i < cpak.rom_count; i++)
+    if (!strcmp(cpak.roms[i], name))
+      break;
+  if (i == cpak.rom_count && cpak.list_valid &&
+      cpak.rom_count < PFU_CPAK_MAX_ROMS)
+    snprintf(cpak.roms[cpak.rom_count++], PFU_CPAK_NAME_SIZE, "%s", name);
+
+  return PFU_CPAK_OK;
+}
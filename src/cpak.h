@@ -0,0 +1,77 @@
+#ifndef PRESS_F_ULTRA_CPAK_H
+#define PRESS_F_ULTRA_CPAK_H
+
+#include "libpressf/src/emu.h"
+
+#define PFU_PATH_CONTROLLER_PAK "cpak1:/HF8E.01"
+
+/* A Controller Pak holds at most 16 notes */
+#define PFU_CPAK_MAX_ROMS 16
+
+/**
+ * Largest note written for one ROM. ROMs that compress to more than this
+ * continue in extra notes named .CH1, .CH2 and so on after the .CHF note,
+ * which are read back in sequence.
+ */
+#define PFU_CPAK_NOTE_SIZE 0x4000
+
+typedef enum
+{
+  PFU_CPAK_OK = 0,
+
+  PFU_CPAK_ERROR_NO_PAK,
+  PFU_CPAK_ERROR_UNFORMATTED,
+  PFU_CPAK_ERROR_MEMORY,
+  PFU_CPAK_ERROR_COMPRESS,
+  PFU_CPAK_ERROR_NO_SPACE,
+  PFU_CPAK_ERROR_OPEN,
+  PFU_CPAK_ERROR_IO,
+  PFU_CPAK_ERROR_FORMAT,
+
+  PFU_CPAK_ERROR_SIZE
+} pfu_cpak_error;
+
+/**
+ * Checks whether a Controller Pak is inserted in the first joypad. When one
+ * is inserted or removed, the mount session and cached directory and stats
+ * are dropped. Returns true if the state changed since the last poll.
+ */
+bool pfu_cpak_poll(void);
+
+/**
+ * Mounts the Controller Pak if it is not already mounted. The mount is kept
+ * until the pak is removed, so repeated access avoids joybus round trips.
+ */
+bool pfu_cpak_mount(void);
+
+/**
+ * Returns the cached usage of the Controller Pak, or NULL if none is
+ * mounted.
+ */
+const cpakfs_stats_t *pfu_cpak_stats(void);
+
+/**
+ * Returns the number of ROMs on the Controller Pak, from the cached
+ * directory, and the name of one of them.
+ */
+unsigned pfu_cpak_rom_count(void);
+
+const char *pfu_cpak_rom_name(unsigned index);
+
+/**
+ * Loads and decompresses a ROM saved to the Controller Pak. size gives the
+ * capacity of dst and receives the decompressed size; hash, if not NULL,
+ * receives its CRC32.
+ */
+pfu_cpak_error pfu_cpak_load(const char *name, void *dst, unsigned *size,
+                             u32 *hash);
+
+/**
+ * Compresses a ROM and saves it to the Controller Pak as the given note
+ * name, without extension. pages and notes receive the space required,
+ * whether or not it was available.
+ */
+pfu_cpak_error pfu_cpak_save(const char *name, const void *data,
+                             unsigned size, unsigned *pages, unsigned *notes);
+
+#endif
@@ -6,27 +6,41 @@
 #include "libpressf/src/hw/beeper.h"
 #include "libpressf/src/hw/vram.h"
 
+#include "audio.h"
+#include "bootcache.h"
+#include "capture.h"
+#include "config.h"
 #include "main.h"
 #include "emu.h"
+#include "error.h"
+#include "overlay.h"
+#include "profile.h"
+#include "stats.h"
 
 #define PFU_EMU_X_MARGIN_240P 24
 #define PFU_EMU_X_MARGIN_480P 48
 #define PFU_EMU_Y_MARGIN_240P 16
 #define PFU_EMU_Y_MARGIN_480P 32
 
+/* Frames averaged for the overclock headroom check */
+#define PFU_EMU_HEADROOM_WINDOW 60
+
 static const rdpq_blitparms_t pfu_1_1_480p_params = {
   .scale_x = 6.0f,
   .scale_y = 6.0f };
 static void pfu_video_render_1_1(void)
 {
+  u32 start = get_ticks();
   surface_t *disp = display_get();
 
+  pfu_stats_wait(get_ticks() - start);
   rdpq_attach_clear(disp, NULL);
   rdpq_set_mode_standard();
   rdpq_tex_blit(&emu.video_frame,
                 14,
                 66,
                 &pfu_1_1_480p_params);
+  pfu_overlay_draw();
   rdpq_detach_show();
 }
 
@@ -35,14 +49,17 @@ static const rdpq_blitparms_t pfu_4_3_480p_params = {
   .scale_y = (480.0f - PFU_EMU_Y_MARGIN_480P * 2) / SCREEN_HEIGHT };
 static void pfu_video_render_4_3(void)
 {
+  u32 start = get_ticks();
   surface_t *disp = display_get();
 
+  pfu_stats_wait(get_ticks() - start);
   rdpq_attach_clear(disp, NULL);
   rdpq_set_mode_standard();
   rdpq_tex_blit(&emu.video_frame,
                 PFU_EMU_X_MARGIN_480P,
                 PFU_EMU_Y_MARGIN_480P,
                 &pfu_4_3_480p_params);
+  pfu_overlay_draw();
   rdpq_detach_show();
 }
 
@@ -70,6 +87,20 @@ static joypad_inputs_t pfu_analog_to_digital(joypad_inputs_t inputs, joypad_styl
   return inputs;
 }
 
+static bool pfu_inputs_active(joypad_inputs_t inputs)
+{
+  return inputs.btn.a || inputs.btn.b || inputs.btn.z || inputs.btn.start ||
+         inputs.btn.d_up || inputs.btn.d_down ||
+         inputs.btn.d_left || inputs.btn.d_right ||
+         inputs.btn.c_up || inputs.btn.c_down ||
+         inputs.btn.c_left || inputs.btn.c_right;
+}
+
+/**
+ * Whether any emulated input was held during the last frame.
+ */
+static bool pfu_input_active;
+
 static void pfu_emu_input(void)
 {
   joypad_inputs_t inputs;
@@ -80,13 +111,33 @@ static void pfu_emu_input(void)
   inputs = joypad_get_inputs(JOYPAD_PORT_1);
   style = joypad_get_style(JOYPAD_PORT_1);
   inputs = pfu_analog_to_digital(inputs, style);
+  pfu_input_active = pfu_inputs_active(inputs);
 
-  /* Handle hotkeys */
-  if (inputs.btn.l)
+  /**
+   * Handle hotkeys; holding Z while pressing L takes a screenshot. Z is then
+   * part of the hotkey, so it is released rather than passed on as HOLD.
+   */
+  if (inputs.btn.l && inputs.btn.z)
+  {
+    if (joypad_get_buttons_pressed(JOYPAD_PORT_1).l)
+      pfu_capture_request();
+    set_input_button(0, INPUT_HOLD, false);
+    return;
+  }
+  else if (inputs.btn.l)
   {
     pfu_menu_switch_roms();
     return;
   }
+#if PFU_PROFILE
+  else if (inputs.btn.r && inputs.btn.z)
+  {
+    if (joypad_get_buttons_pressed(JOYPAD_PORT_1).r)
+      PFU_PROFILE_DUMP();
+    set_input_button(0, INPUT_HOLD, false);
+    return;
+  }
+#endif
   else if (inputs.btn.r)
   {
     pfu_menu_switch_settings();
@@ -113,6 +164,7 @@ static void pfu_emu_input(void)
   inputs = joypad_get_inputs(JOYPAD_PORT_2);
   style = joypad_get_style(JOYPAD_PORT_2);
   inputs = pfu_analog_to_digital(inputs, style);
+  pfu_input_active |= pfu_inputs_active(inputs);
 
   /* Handle player 2 input */
   port = emu.swap_controllers ? 4 : 1;
@@ -126,28 +178,86 @@ static void pfu_emu_input(void)
   set_input_button(port, INPUT_PUSH, inputs.btn.c_down);
 }
 
+/**
+ * Warns once per multiplier if the frames of an overclocked game take longer
+ * than the display allows, as it will then slow down regardless of the
+ * overclock. The work of a frame is its duration less the time spent
+ * waiting.
+ */
+static void pfu_emu_headroom(void)
+{
+  static u32 busy_ticks;
+  static unsigned frames;
+  static bool warned[PFU_OVERCLOCK_SIZE];
+
+  if (emu.overclock == PFU_OVERCLOCK_1X || warned[emu.overclock])
+  {
+    busy_ticks = 0;
+    frames = 0;
+    return;
+  }
+  busy_ticks += pfu_stats.frame_ticks - pfu_stats.wait_ticks;
+  if (++frames < PFU_EMU_HEADROOM_WINDOW)
+    return;
+  else if (busy_ticks / PFU_EMU_HEADROOM_WINDOW > pfu_stats.frame_budget)
+  {
+    warned[emu.overclock] = true;
+    pfu_message_switch(PFU_STATE_EMU,
+      "This CPU overclock can't be sustained on this console.\n\n"
+      "Each frame needs %lu us of work, but only %lu us are available.\n"
+      "Lower the overclock in the settings menu to avoid slowdown.",
+      (unsigned long)TICKS_TO_US(busy_ticks / PFU_EMU_HEADROOM_WINDOW),
+      (unsigned long)TICKS_TO_US(pfu_stats.frame_budget));
+  }
+  busy_ticks = 0;
+  frames = 0;
+}
+
 void pfu_emu_run(void)
 {
+  u32 start;
+
   /* Input */
+  PFU_PROFILE_BEGIN(PFU_PROFILE_INPUT);
   pfu_emu_input();
+  PFU_PROFILE_END(PFU_PROFILE_INPUT);
 
   /* Emulation */
+  PFU_PROFILE_BEGIN(PFU_PROFILE_EMULATION);
+  start = get_ticks();
   pressf_run(&emu.system);
+  pfu_stats.emulation_ticks = get_ticks() - start;
+  PFU_PROFILE_END(PFU_PROFILE_EMULATION);
+  PFU_PROFILE_GUEST();
+  pfu_bootcache_frame(pfu_input_active);
 
   /* Video */
+  PFU_PROFILE_BEGIN(PFU_PROFILE_VIDEO);
   draw_frame_rgb5551(((vram_t*)emu.system.f8devices[3].device)->data, emu.video_buffer);
+  pfu_capture_frame();
+  PFU_PROFILE_END(PFU_PROFILE_VIDEO);
 
   /* Audio */
-  audio_push(((f8_beeper_t*)emu.system.f8devices[7].device)->samples, PF_SOUND_SAMPLES, true);
+  PFU_PROFILE_BEGIN(PFU_PROFILE_AUDIO);
+  pfu_audio_push(((f8_beeper_t*)emu.system.f8devices[7].device)->samples);
+  PFU_PROFILE_END(PFU_PROFILE_AUDIO);
 
   /* Blit the frame */
+  PFU_PROFILE_BEGIN(PFU_PROFILE_RENDER);
   if (emu.video_scaling == PFU_SCALING_1_1)
     pfu_video_render_1_1();
   else
     pfu_video_render_4_3();
+  PFU_PROFILE_END(PFU_PROFILE_RENDER);
+
+  pfu_emu_headroom();
 }
 
 void pfu_emu_switch(void)
 {
   emu.state = PFU_STATE_EMU;
+
+  /* Settings can only have changed in a menu, which is now closed */
+  pfu_bootcache_resume();
+  pfu_config_flush();
 }
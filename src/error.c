@@ -18,7 +18,7 @@ void pfu_error_switch(const char *error, ...)
 
 void pfu_message_switch(unsigned state, const char *message, ...)
 {
-  surface_t *disp = display_get();
+  surface_t *disp;
   char text[1024];
 
   va_list args;
@@ -26,18 +26,20 @@ void pfu_message_switch(unsigned state, const char *message, ...)
   vsnprintf(text, sizeof(text), message, args);
   va_end(args);
 
+  pfu_assets_init();
+  disp = display_get();
   rdpq_attach_clear(disp, NULL);
   rdpq_set_mode_fill(RGBA32(0x22, 0x22, 0x22, 1));
   rdpq_fill_rectangle(0, 0, display_get_width(), display_get_height());
 
   rdpq_set_mode_copy(false);
-  rdpq_sprite_blit(emu.icon, 48, 32, NULL);
+  rdpq_sprite_blit(frontend.icon, 48, 32, NULL);
   rdpq_text_printf(
     &(rdpq_textparms_t){
       .width = 640 - 64*2,
       .height = 480 - 64*2,
 		  .align = ALIGN_CENTER
-	  }, 1, 64, 128, text);
+	  }, PFU_FONT_MAIN, 64, 128, text);
 
   rdpq_detach_show();
 
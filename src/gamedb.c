@@ -0,0 +1,122 @@
+#include <libdragon.h>
+
+#include "gamedb.h"
+#include "memory.h"
+
+#define PFU_GAMEDB_HEADER_SIZE 8
+#define PFU_GAMEDB_ENTRY_SIZE 8
+
+static u32 pfu_crc32_table[256];
+static bool pfu_crc32_table_ready = false;
+
+static u8 *pfu_gamedb_data = NULL;
+static unsigned pfu_gamedb_count = 0;
+static bool pfu_gamedb_loaded = false;
+
+static void pfu_crc32_init(void)
+{
+  unsigned i, j;
+
+  for (i = 0; i < 256; i++)
+  {
+    u32 c = i;
+
+    for (j = 0; j < 8; j++)
+      c = c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+    pfu_crc32_table[i] = c;
+  }
+  pfu_crc32_table_ready = true;
+}
+
+u32 pfu_crc32(u32 crc, const void *data, unsigned size)
+{
+  const u8 *src = (const u8*)data;
+  unsigned i;
+
+  if (!pfu_crc32_table_ready)
+    pfu_crc32_init();
+
+  crc = ~crc;
+  for (i = 0; i < size; i++)
+    crc = pfu_crc32_table[(crc ^ src[i]) & 0xFF] ^ (crc >> 8);
+
+  return ~crc;
+}
+
+static u32 pfu_gamedb_read_u32(const u8 *src)
+{
+  return ((u32)src[0] << 24) | ((u32)src[1] << 16) |
+         ((u32)src[2] << 8) | (u32)src[3];
+}
+
+/**
+ * Reads the whole database with one file read. A missing or malformed
+ * database is treated as empty so ROMs still load with global settings.
+ */
+static void pfu_gamedb_load(void)
+{
+  FILE *file;
+  u8 header[PFU_GAMEDB_HEADER_SIZE];
+
+  pfu_gamedb_loaded = true;
+  file = fopen(PFU_GAMEDB_PATH, "rb");
+  if (!file)
+    return;
+
+  if (fread(header, 1, sizeof(header), file) == sizeof(header) &&
+      pfu_gamedb_read_u32(header) == PFU_GAMEDB_MAGIC &&
+      ((header[4] << 8) | header[5]) == PFU_GAMEDB_VERSION)
+  {
+    unsigned count = (header[6] << 8) | header[7];
+    unsigned size = count * PFU_GAMEDB_ENTRY_SIZE;
+
+    if (count)
+    {
+      pfu_gamedb_data = pfu_malloc(PFU_MEMORY_ASSETS, size);
+      if (pfu_gamedb_data && fread(pfu_gamedb_data, 1, size, file) == size)
+        pfu_gamedb_count = count;
+      else
+      {
+        pfu_free(pfu_gamedb_data);
+        pfu_gamedb_data = NULL;
+      }
+    }
+  }
+  fclose(file);
+}
+
+bool pfu_gamedb_find(u32 hash, pfu_gamedb_entry_t *entry)
+{
+  unsigned low = 0, high;
+
+  if (!pfu_gamedb_loaded)
+    pfu_gamedb_load();
+
+  /* Binary search over the records, which are sorted by hash */
+  high = pfu_gamedb_count;
+  while (low < high)
+  {
+    unsigned mid = low + (high - low) / 2;
+    const u8 *record = &pfu_gamedb_data[mid * PFU_GAMEDB_ENTRY_SIZE];
+    u32 record_hash = pfu_gamedb_read_u32(record);
+
+    if (record_hash == hash)
+    {
+      if (entry)
+      {
+        entry->hash = record_hash;
+        entry->clock = record[4];
+        entry->font = record[5];
+        entry->flags = record[6];
+        entry->swap = record[7];
+      }
+      return true;
+    }
+    else if (record_hash < hash)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+
+  return false;
+}
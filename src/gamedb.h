@@ -0,0 +1,56 @@
+#ifndef PRESS_F_ULTRA_GAMEDB_H
+#define PRESS_F_ULTRA_GAMEDB_H
+
+#include "libpressf/src/emu.h"
+
+#define PFU_GAMEDB_PATH "rom:/gamedb.bin"
+#define PFU_GAMEDB_MAGIC 0x50464442 /* "PFDB" */
+#define PFU_GAMEDB_VERSION 2
+
+/* Value used for a clock, font or swap field with no preference */
+#define PFU_GAMEDB_UNSET 0xFF
+
+typedef enum
+{
+  PFU_GAMEDB_FLAG_NONE = 0,
+
+  /* Title has been verified to run correctly */
+  PFU_GAMEDB_FLAG_GOOD = 1 << 0,
+
+  /* Title is known to have emulation issues */
+  PFU_GAMEDB_FLAG_ISSUES = 1 << 1
+} pfu_gamedb_flag;
+
+/**
+ * A single game database record. Records are stored sorted by hash, 8 bytes
+ * each, big-endian, following an 8-byte header of magic, version and count.
+ */
+typedef struct
+{
+  u32 hash;
+
+  /* Index into the "System CPU clock" setting choices, or PFU_GAMEDB_UNSET */
+  u8 clock;
+
+  /* Index into the "System font" setting choices, or PFU_GAMEDB_UNSET */
+  u8 font;
+
+  /* Bitfield of pfu_gamedb_flag */
+  u8 flags;
+
+  /* 1 to swap player 1 / player 2 controllers, 0 not to, or PFU_GAMEDB_UNSET */
+  u8 swap;
+} pfu_gamedb_entry_t;
+
+/**
+ * Updates a running CRC32 with the given data. Start with a CRC of 0.
+ */
+u32 pfu_crc32(u32 crc, const void *data, unsigned size);
+
+/**
+ * Looks up a ROM hash in the game database, loading the database on first
+ * use. Returns true and fills the entry if the hash is known.
+ */
+bool pfu_gamedb_find(u32 hash, pfu_gamedb_entry_t *entry);
+
+#endif
@@ -8,11 +8,21 @@
 #include "libpressf/src/emu.h"
 #include "libpressf/src/screen.h"
 
+#include "audio.h"
+#include "bootcache.h"
+#include "capture.h"
+#include "config.h"
 #include "main.h"
 #include "emu.h"
+#include "error.h"
+#include "memory.h"
 #include "menu.h"
+#include "microbench.h"
+#include "stats.h"
+#include "suspend.h"
 
-pfu_emu_ctx_t emu;
+pfu_emu_ctx_t emu __attribute__((aligned(PFU_CACHE_LINE)));
+pfu_frontend_ctx_t frontend;
 
 /**
  * Returns the memory location of a stamped ROM when loading as a plugin, or
@@ -41,39 +51,79 @@ static unsigned long pfu_plugin_rom_address(void)
  * The Channel F sanity byte $55 is checked to ensure the ROM is valid, which
  * may exclude some older homebrew ROMs.
  * 
- * As the accurate ROMC mode is not used on Nintendo 64, a maximum-sized ROM
- * can be loaded contiguously into the entire F8 address space, then
- * overwritten later.
+ * A maximum-sized ROM is loaded contiguously, then overwritten later.
  */
 static bool pfu_plugin_read_rom(void)
 {
-  u8 buffer[0xF800];
+  const unsigned size = PFU_ROM_MAX_SIZE;
   const unsigned long base = pfu_plugin_rom_address();
+  bool loaded = false;
+  u8 *buffer;
 
   if (!base)
     return false;
-  else
+
+  buffer = pfu_malloc(PFU_MEMORY_LOADER, size);
+  if (buffer)
   {
-    dma_read_async(buffer, base, sizeof(buffer));
+    dma_read_async(buffer, base, size);
     dma_wait();
 
     if (buffer[0] == 0x55)
     {
-      f8_write(&emu.system, 0x0800, buffer, sizeof(buffer));
-      memset(buffer, 0, sizeof(buffer));
-      dma_write_raw_async(buffer, base, sizeof(buffer));
+      f8_write(&emu.system, 0x0800, buffer, size);
+      memset(buffer, 0, size);
+      dma_write_raw_async(buffer, base, size);
       dma_wait();
-
-      return true;
+      loaded = true;
     }
+    pfu_free(buffer);
   }
 
-  return false;
+  return loaded;
+}
+
+/**
+ * Loads the fonts and icon used by the menus and messages. Done on first use,
+ * so booting straight into a plugin ROM does not wait on them.
+ */
+void pfu_assets_init(void)
+{
+  rdpq_font_t *font;
+  unsigned heap_used;
+
+  if (frontend.icon)
+    return;
+  heap_used = pfu_memory_heap_used();
+
+  /* One font is shared by the normal and drop shadow styles */
+  font = rdpq_font_load("rom:/Tuffy_Bold.font64");
+  assertf(font, "Failed to load font: Tuffy_Bold.font64");
+  rdpq_text_register_font(PFU_FONT_MAIN, font);
+  rdpq_font_style(font, PFU_FONT_STYLE_NORMAL, &(rdpq_fontstyle_t){
+	                .color = RGBA32(255, 255, 255, 255),
+	                .outline_color = RGBA32(0, 0, 0, 255)});
+  rdpq_font_style(font, PFU_FONT_STYLE_SHADOW, &(rdpq_fontstyle_t){
+	                .color = RGBA32(0, 0, 0, 127),
+	                .outline_color = RGBA32(0, 0, 0, 127)});
+  rdpq_text_register_font(PFU_FONT_DEBUG,
+    rdpq_font_load_builtin(FONT_BUILTIN_DEBUG_VAR));
+
+  frontend.icon = sprite_load("rom:/icon.sprite");
+  assertf(frontend.icon, "Failed to load icon sprite: icon.sprite");
+  pfu_memory_account(PFU_MEMORY_ASSETS, pfu_memory_heap_used() - heap_used);
+  pfu_stats_boot_mark("assets");
 }
 
 int main(void)
 {
+  int dfs_result;
+  unsigned heap_used;
+
+  pfu_memory_stack_paint();
   memset(&emu, 0, sizeof(emu));
+  memset(&frontend, 0, sizeof(frontend));
+  pfu_stats_boot_mark("start");
 
   /* Initialize console */
   rdpq_init();
@@ -84,64 +134,70 @@ int main(void)
   /* Initialize controller */
   joypad_init();
 
-  /* Initialize assets */
-  int dfs_result = dfs_init(DFS_DEFAULT_LOCATION);
+  /* Initialize filesystems */
+  dfs_result = dfs_init(DFS_DEFAULT_LOCATION);
   if (dfs_result < 0)
   {
     printf("Failed to initialize DFS: %d\n", dfs_result);
     return -1;
   }
-
-  /* Initialize fonts */
-  rdpq_font_t *font1 = rdpq_font_load("rom:/Tuffy_Bold.font64");
-  if (!font1)
-  {
-    printf("Failed to load font: Tuffy_Bold.font64\n");
-    return -1;
-  }
-  rdpq_text_register_font(1, font1);
-  rdpq_font_style(font1, 0, &(rdpq_fontstyle_t){
-	                .color = RGBA32(255, 255, 255, 255),
-	                .outline_color = RGBA32(0, 0, 0, 255)});
-  rdpq_font_t *font2 = rdpq_font_load("rom:/Tuffy_Bold.font64");
-  rdpq_text_register_font(2, font2);
-  rdpq_font_style(font2, 0, &(rdpq_fontstyle_t){
-	                .color = RGBA32(0, 0, 0, 127),
-	                .outline_color = RGBA32(0, 0, 0, 127)});
-  rdpq_font_t *font3 = rdpq_font_load_builtin(FONT_BUILTIN_DEBUG_VAR);
-  rdpq_text_register_font(3, font3);
-
-  emu.icon = sprite_load("rom:/icon.sprite");
-  if (!emu.icon)
-  {
-    printf("Failed to load icon sprite: icon.sprite\n");
-    return -1;
-  }
   debug_init_sdfs("sd:/", -1);
+  pfu_stats_boot_mark("filesystems");
 
   /* Initialize audio */
-  audio_init(PF_SOUND_FREQUENCY, 4);
+  pfu_audio_init(PFU_AUDIO_RATE_44100);
 
   /* Initialize video */
   console_close();
+  heap_used = pfu_memory_heap_used();
   display_init(RESOLUTION_640x480, DEPTH_16_BPP, 2, GAMMA_NONE, FILTERS_RESAMPLE);
   emu.video_buffer = (u16*)malloc_uncached_aligned(64, SCREEN_WIDTH * SCREEN_HEIGHT * 2);
+  pfu_memory_account(PFU_MEMORY_VIDEO, pfu_memory_heap_used() - heap_used);
   emu.video_frame = surface_make_linear(emu.video_buffer, FMT_RGBA16, SCREEN_WIDTH, SCREEN_HEIGHT);
   emu.video_scaling = PFU_SCALING_4_3;
+  pfu_stats_boot_mark("audio_video");
 
   /* Initialize emulator */
   pressf_init(&emu.system);
   f8_system_init(&emu.system, F8_SYSTEM_CHANNEL_F);
+  pfu_config_load();
   pfu_menu_init();
-
-  /* If loaded as plugin, jump to loaded ROM, otherwise load ROM menu */
+  pfu_stats_boot_mark("core");
+
+#if PFU_MICROBENCH
+  pfu_microbench_run(&emu.system);
+  pfu_error_switch("F8 microbenchmarks written to:\n%s", PFU_PATH_MICROBENCH);
+#endif
+
+  /**
+   * If loaded as plugin, jump to loaded ROM with only the BIOS loaded, which
+   * are scanned for if not found by name.
+   * Otherwise, offer to resume a suspended session, then load the last ROM
+   * if autoload is enabled, then fall back to scanning for ROMs and loading
+   * the ROM menu.
+   */
   if (pfu_plugin_read_rom())
+  {
+    pfu_stats_boot_mark("plugin_rom");
+    if (pfu_menu_load_bios() || pfu_menu_find_bios())
+    {
+      pfu_stats_boot_mark("bios");
+      pfu_emu_switch();
+    }
+  }
+  else if (pfu_suspend_resume())
     pfu_emu_switch();
+  else if (pfu_config_setting(PFU_ENTRY_KEY_AUTOLOAD) && pfu_menu_autoload())
+    pfu_stats_boot_mark("autoload");
   else
+  {
     pfu_menu_switch_roms();
+    pfu_stats_boot_mark("rom_scan");
+  }
 
   while (64)
   {
+    pfu_stats_frame();
     switch (emu.state)
     {
     case PFU_STATE_MENU:
@@ -153,6 +209,14 @@ int main(void)
     default:
       exit(0);
     }
+    pfu_capture_step();
+    pfu_suspend_step();
+    pfu_bootcache_step();
+    if (!emu.frames)
+    {
+      pfu_stats_boot_mark("first_frame");
+      pfu_stats_boot_log(emu.state == PFU_STATE_EMU ? "emu" : "menu");
+    }
     emu.frames++;
   }
 }
@@ -5,6 +5,28 @@
 
 #include "menu.h"
 
+/* Font IDs registered with rdpq_text */
+#define PFU_FONT_MAIN 1
+#define PFU_FONT_DEBUG 3
+
+/* Bytes in a VR4300 data cache line */
+#define PFU_CACHE_LINE 16
+
+/* Styles of PFU_FONT_MAIN */
+#define PFU_FONT_STYLE_NORMAL 0
+#define PFU_FONT_STYLE_SHADOW 1
+
+/**
+ * Largest ROM image loaded at $0800. Unless built with the accurate ROMC
+ * mode, a ROM can fill the rest of the F8 address space. With ROMC, higher
+ * addresses may be mapped to cartridge devices.
+ */
+#if PF_ROMC
+#define PFU_ROM_MAX_SIZE 0x4000
+#else
+#define PFU_ROM_MAX_SIZE 0xF800
+#endif
+
 typedef enum
 {
   PFU_SCALING_1_1 = 0,
@@ -13,6 +35,20 @@ typedef enum
   PFU_SCALING_SIZE
 } pfu_scaling_type;
 
+/**
+ * Multipliers of the emulated CPU clock. More instructions run per video
+ * frame, which removes slowdown in busy scenes.
+ */
+typedef enum
+{
+  PFU_OVERCLOCK_1X = 0,
+  PFU_OVERCLOCK_1_5X,
+  PFU_OVERCLOCK_2X,
+  PFU_OVERCLOCK_3X,
+
+  PFU_OVERCLOCK_SIZE
+} pfu_overclock_type;
+
 typedef enum
 {
   PFU_STATE_INVALID = 0,
@@ -23,23 +59,41 @@ typedef enum
   PFU_STATE_SIZE
 } pfu_state_type;
 
+/**
+ * State used by every emulated frame. The fields read each frame share the
+ * first cache lines, and the system starts on a line of its own, so a frame
+ * does not pull in unrelated frontend data. Anything else goes in
+ * pfu_frontend_ctx_t. Only the frontend side is arranged here; the layout
+ * of the registers, scratchpad and device table inside f8_system_t is
+ * libpressf's.
+ */
 typedef struct
 {
-  u16* video_buffer;
-  surface_t video_frame;
-  pfu_scaling_type video_scaling;
   pfu_state_type state;
-  f8_system_t system;
-  bool bios_a_loaded;
-  bool bios_b_loaded;
-  pfu_menu_ctx_t menu_roms;
-  pfu_menu_ctx_t menu_settings;
-  pfu_menu_ctx_t *current_menu;
   unsigned frames;
-  sprite_t *icon;
+  pfu_scaling_type video_scaling;
+  pfu_overclock_type overclock;
   bool swap_controllers;
+  u16* video_buffer;
+  surface_t video_frame;
+  f8_system_t system __attribute__((aligned(PFU_CACHE_LINE)));
 } pfu_emu_ctx_t;
 
+/**
+ * Frontend state used when loading, booting or drawing menus and messages.
+ */
+typedef struct
+{
+  sprite_t *icon;
+  bool bios_a_loaded;
+  bool bios_b_loaded;
+  u32 rom_hash;
+} pfu_frontend_ctx_t;
+
 extern pfu_emu_ctx_t emu;
 
+extern pfu_frontend_ctx_t frontend;
+
+void pfu_assets_init(void);
+
 #endif
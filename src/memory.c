@@ -0,0 +1,159 @@
+#include <libdragon.h>
+#include <malloc.h>
+
+#include "memory.h"
+
+#define PFU_MEMORY_STACK_PATTERN 0x50465553 /* "PFUS" */
+
+/* Stack in use by the painting function and interrupts while it runs */
+#define PFU_MEMORY_STACK_MARGIN 0x400
+
+/**
+ * Prefixed to each tracked block. Padded to 16 bytes to keep the alignment
+ * malloc guarantees.
+ */
+typedef struct
+{
+  u32 tag;
+  u32 size;
+  u32 reserved[2];
+} pfu_memory_header_t;
+
+static pfu_memory_usage_t pfu_memory_tags[PFU_MEMORY_TAG_SIZE];
+static pfu_memory_usage_t pfu_memory_total;
+
+static u32 *pfu_memory_stack_top;
+static u32 *pfu_memory_stack_bottom;
+
+static const char *pfu_memory_tag_names[PFU_MEMORY_TAG_SIZE] = {
+  "Menu",
+  "Video",
+  "Audio",
+  "Loader",
+  "Assets",
+  "State",
+  "Cache"
+};
+
+static void pfu_memory_update(pfu_memory_usage_t *usage, int size)
+{
+  if (size < 0 && (unsigned)-size > usage->current)
+    usage->current = 0;
+  else
+    usage->current += size;
+  if (size > 0)
+    usage->allocations++;
+  if (usage->current > usage->peak)
+    usage->peak = usage->current;
+}
+
+void pfu_memory_account(pfu_memory_tag tag, int size)
+{
+  pfu_memory_update(&pfu_memory_tags[tag], size);
+  pfu_memory_update(&pfu_memory_total, size);
+}
+
+void *pfu_malloc(pfu_memory_tag tag, unsigned size)
+{
+  pfu_memory_header_t *header = malloc(sizeof(pfu_memory_header_t) + size);
+
+  if (!header)
+    return NULL;
+  header->tag = tag;
+  header->size = size;
+  pfu_memory_account(tag, size);
+
+  return header + 1;
+}
+
+void *pfu_calloc(pfu_memory_tag tag, unsigned count, unsigned size)
+{
+  void *ptr = pfu_malloc(tag, count * size);
+
+  if (ptr)
+    memset(ptr, 0, count * size);
+
+  return ptr;
+}
+
+void pfu_free(void *ptr)
+{
+  if (ptr)
+  {
+    pfu_memory_header_t *header = ((pfu_memory_header_t*)ptr) - 1;
+
+    pfu_memory_account(header->tag, -(int)header->size);
+    free(header);
+  }
+}
+
+unsigned pfu_memory_heap_used(void)
+{
+  struct mallinfo info = mallinfo();
+
+  return info.uordblks;
+}
+
+const pfu_memory_usage_t *pfu_memory_usage(pfu_memory_tag tag)
+{
+  return tag < PFU_MEMORY_TAG_SIZE ? &pfu_memory_tags[tag] : &pfu_memory_total;
+}
+
+const char *pfu_memory_tag_name(pfu_memory_tag tag)
+{
+  return pfu_memory_tag_names[tag];
+}
+
+void pfu_memory_stack_paint(void)
+{
+  volatile u32 marker;
+  u32 *ptr;
+
+  pfu_memory_stack_top = (u32*)(((unsigned long)&marker -
+    PFU_MEMORY_STACK_MARGIN) & ~3UL);
+  pfu_memory_stack_bottom = pfu_memory_stack_top -
+    PFU_MEMORY_STACK_PAINT / sizeof(u32);
+  for (ptr = pfu_memory_stack_bottom; ptr < pfu_memory_stack_top; ptr++)
+    *ptr = PFU_MEMORY_STACK_PATTERN;
+}
+
+unsigned pfu_memory_stack_high_water(void)
+{
+  const u32 *ptr;
+
+  if (!pfu_memory_stack_top)
+    return 0;
+  for (ptr = pfu_memory_stack_bottom; ptr < pfu_memory_stack_top; ptr++)
+    if (*ptr != PFU_MEMORY_STACK_PATTERN)
+      break;
+
+  return PFU_MEMORY_STACK_MARGIN + (pfu_memory_stack_top - ptr) * sizeof(u32);
+}
+
+void pfu_memory_report(void)
+{
+  FILE *file = fopen(PFU_PATH_MEMORY_REPORT, "w");
+  unsigned i;
+
+  if (!file)
+    return;
+
+  fprintf(file, "Press F Ultra memory report\n");
+  fprintf(file, "RAM: %u KB (Expansion Pak %s)\n", get_memory_size() / 1024,
+          is_memory_expanded() ? "present" : "not present");
+  fprintf(file, "Heap in use: %u KB\n", pfu_memory_heap_used() / 1024);
+  fprintf(file, "Stack high-water: %u bytes (of %u painted)\n\n",
+          pfu_memory_stack_high_water(),
+          PFU_MEMORY_STACK_PAINT + PFU_MEMORY_STACK_MARGIN);
+  fprintf(file, "Tag      Current KB  Peak KB  Allocations\n");
+  for (i = 0; i < PFU_MEMORY_TAG_SIZE; i++)
+  {
+    fprintf(file, "%-8s %10u %8u %12u\n", pfu_memory_tag_names[i],
+            pfu_memory_tags[i].current / 1024, pfu_memory_tags[i].peak / 1024,
+            pfu_memory_tags[i].allocations);
+  }
+  fprintf(file, "%-8s %10u %8u %12u\n", "Total",
+          pfu_memory_total.current / 1024, pfu_memory_total.peak / 1024,
+          pfu_memory_total.allocations);
+  fclose(file);
+}
@@ -0,0 +1,76 @@
+#ifndef PRESS_F_ULTRA_MEMORY_H
+#define PRESS_F_ULTRA_MEMORY_H
+
+#include "libpressf/src/emu.h"
+
+#define PFU_PATH_MEMORY_REPORT "sd:/press-f/memory.txt"
+
+/* Bytes below the stack pointer at startup painted to find stack usage */
+#define PFU_MEMORY_STACK_PAINT 0x8000
+
+typedef enum
+{
+  PFU_MEMORY_MENU = 0,
+  PFU_MEMORY_VIDEO,
+  PFU_MEMORY_AUDIO,
+  PFU_MEMORY_LOADER,
+  PFU_MEMORY_ASSETS,
+  PFU_MEMORY_STATE,
+  PFU_MEMORY_CACHE,
+
+  PFU_MEMORY_TAG_SIZE
+} pfu_memory_tag;
+
+typedef struct
+{
+  unsigned current;
+  unsigned peak;
+  unsigned allocations;
+} pfu_memory_usage_t;
+
+/**
+ * Allocates frontend memory, accounted under the given tag. Blocks must be
+ * released with pfu_free.
+ */
+void *pfu_malloc(pfu_memory_tag tag, unsigned size);
+
+void *pfu_calloc(pfu_memory_tag tag, unsigned count, unsigned size);
+
+void pfu_free(void *ptr);
+
+/**
+ * Accounts memory allocated elsewhere, such as uncached buffers or memory
+ * owned by libdragon. Size may be negative when memory is released.
+ */
+void pfu_memory_account(pfu_memory_tag tag, int size);
+
+/**
+ * Returns the bytes of heap currently in use, from any allocator. Used to
+ * measure allocations made inside libraries.
+ */
+unsigned pfu_memory_heap_used(void);
+
+/**
+ * Returns usage for one tag, or for all tags with PFU_MEMORY_TAG_SIZE.
+ */
+const pfu_memory_usage_t *pfu_memory_usage(pfu_memory_tag tag);
+
+const char *pfu_memory_tag_name(pfu_memory_tag tag);
+
+/**
+ * Fills unused stack below the caller with a known pattern. Call once, as
+ * early as possible in main.
+ */
+void pfu_memory_stack_paint(void);
+
+/**
+ * Returns the deepest stack use seen since pfu_memory_stack_paint, in bytes.
+ */
+unsigned pfu_memory_stack_high_water(void);
+
+/**
+ * Writes a memory report to the SD Card.
+ */
+void pfu_memory_report(void);
+
+#endif
@@ -6,11 +6,23 @@
 #include "libpressf/src/emu.h"
 #include "libpressf/src/font.h"
 
+#include "audio.h"
+#include "bootcache.h"
+#include "capture.h"
+#include "config.h"
+#include "cpak.h"
 #include "emu.h"
 #include "error.h"
+#include "gamedb.h"
 #include "main.h"
+#include "memory.h"
 #include "menu.h"
-#include "FastLZ/fastlz.h"
+#include "overlay.h"
+#include "romcache.h"
+#include "romfs.h"
+#include "romlist.h"
+#include "stats.h"
+#include "suspend.h"
 
 enum
 {
@@ -23,96 +35,111 @@ enum
   PFU_SOURCE_SIZE
 };
 
-#define PFU_PATH_CONTROLLER_PAK "cpak1:/HF8E.01"
-#define PFU_PATH_ROMFS "rom:/roms"
 #define PFU_PATH_SD_CARD "sd:/press-f"
 
-static const u16 pfu_compression_magic = 0xF8CF;
-static bool pfu_pak_connected = false;
-
+/**
+ * The menus are only touched while one is shown, so they are kept here
+ * rather than alongside the state used by every emulated frame.
+ */
 typedef struct
 {
-  u16 magic;
-  u16 original_size;
-  u16 compressed_size;
-} pfu_compression_header_t;
+  pfu_menu_ctx_t roms;
+  pfu_menu_ctx_t settings;
+  pfu_menu_ctx_t *current;
+} pfu_menus_t;
+
+static pfu_menus_t pfu_menus;
+
+/* Files are read in chunks of this size so each is hashed while cached */
+#define PFU_LOAD_CHUNK_SIZE 0x800
 
-static int pfu_load_file(void *dst, unsigned size, const char *path, unsigned source)
+static void pfu_source_path(char *dst, unsigned size, const char *path,
+                            unsigned source)
+{
+  const char *prefix = NULL;
+
+  switch (source)
+  {
+  case PFU_SOURCE_CONTROLLER_PAK:
+    prefix = PFU_PATH_CONTROLLER_PAK;
+    break;
+  case PFU_SOURCE_SD_CARD:
+    prefix = PFU_PATH_SD_CARD;
+    break;
+  default:
+    pfu_message_switch(PFU_STATE_MENU,
+      "Invalid source for loading file: %u", source);
+  }
+  snprintf(dst, size, "%s/%s", prefix, path);
+}
+
+/**
+ * Loads a file from the given source into dst. If hash is not NULL, it
+ * receives the CRC32 of the loaded (decompressed) data, computed while the
+ * file is streamed in rather than as a second pass.
+ */
+static int pfu_load_file(void *dst, unsigned size, const char *path,
+                         unsigned source, u32 *hash)
 {
   if (source == PFU_SOURCE_INVALID || source >= PFU_SOURCE_SIZE)
     return 0;
+  else if (source == PFU_SOURCE_ROMFS)
+  {
+    int index = pfu_romfs_find(path);
+    unsigned bytes_read = index < 0 ? 0 : pfu_romfs_load(index, dst, size, hash);
+
+    if (bytes_read)
+      return bytes_read;
+    pfu_message_switch(PFU_STATE_MENU,
+      "Failed to load bundled ROM:\n%s\n", path);
+  }
+  else if (source == PFU_SOURCE_CONTROLLER_PAK)
+  {
+    pfu_cpak_error error = pfu_cpak_load(path, dst, &size, hash);
+
+    if (error == PFU_CPAK_OK)
+      return size;
+    else if (error == PFU_CPAK_ERROR_FORMAT)
+      pfu_message_switch(PFU_STATE_MENU,
+        "Invalid Controller Pak file format:\n%s/%s", PFU_PATH_CONTROLLER_PAK,
+        path);
+    else if (error == PFU_CPAK_ERROR_MEMORY)
+      pfu_message_switch(PFU_STATE_MENU,
+        "Not enough memory to load Controller Pak data.");
+    else
+      pfu_message_switch(PFU_STATE_MENU,
+        "Failed to read from Controller Pak:\n%s/%s", PFU_PATH_CONTROLLER_PAK,
+        path);
+  }
   else
   {
     FILE *file;
-    const char *prefix = NULL;
     char fullpath[1024];
 
-    switch (source)
-    {
-    case PFU_SOURCE_CONTROLLER_PAK:
-      prefix = PFU_PATH_CONTROLLER_PAK;
-      break;
-    case PFU_SOURCE_ROMFS:
-      prefix = PFU_PATH_ROMFS;
-      break;
-    case PFU_SOURCE_SD_CARD:
-      prefix = PFU_PATH_SD_CARD;
-      break;
-    default:
-      pfu_message_switch(PFU_STATE_MENU,
-        "Invalid source for loading file: %u", source);
-    }
-    snprintf(fullpath, sizeof(fullpath), "%s/%s", prefix, path);
-
-    if (source == PFU_SOURCE_CONTROLLER_PAK)
-      cpakfs_mount(JOYPAD_PORT_1, "cpak1:/");
+    pfu_source_path(fullpath, sizeof(fullpath), path, source);
     file = fopen(fullpath, "rb");
     if (file)
     {
-      size_t bytes_read = fread(dst, sizeof(char), size, file);
-      fclose(file);
+      size_t bytes_read = 0;
+      u32 crc = 0;
 
-      if (source == PFU_SOURCE_CONTROLLER_PAK)
+      while (bytes_read < size)
       {
-        pfu_compression_header_t header;
-        u8 *output;
-        u8 *compressed_ptr;
-        int decompressed_size;
-
-        /* Read compression header */
-        memcpy(&header, dst, sizeof(header));
-        if (header.magic != pfu_compression_magic)
-        {
-          pfu_message_switch(PFU_STATE_MENU,
-            "Invalid Controller Pak file format:\n%s\n\n"
-            "Expected magic: 0x%08X, got: 0x%08X",
-            fullpath, pfu_compression_magic, header.magic);
-          bytes_read = 0;
-        }
-
-        /* Decompress file */
-        output = (u8*)malloc(header.original_size);
-        compressed_ptr = ((u8*)dst) + sizeof(header);
-        decompressed_size = fastlz_decompress(compressed_ptr,
-          header.compressed_size, output, header.original_size);
-        if (decompressed_size <= 0)
-        {
-          pfu_message_switch(PFU_STATE_MENU,
-            "Failed to decompress Controller Pak data:\n%s\n\n"
-            "Header original size: %i\n"
-            "Header compressed size: %i\n"
-            "Decompressed size: %i\n", strerror(errno),
-            header.original_size, header.compressed_size, decompressed_size);
-          bytes_read = 0;
-        }
-        else
-        {
-          memcpy(dst, output, decompressed_size);
-          bytes_read = decompressed_size;
-        }
-        cpakfs_unmount(JOYPAD_PORT_1);
-        free(output);
+        u8 *chunk_dst = ((u8*)dst) + bytes_read;
+        unsigned chunk_size = size - bytes_read;
+        size_t chunk_read;
+
+        if (chunk_size > PFU_LOAD_CHUNK_SIZE)
+          chunk_size = PFU_LOAD_CHUNK_SIZE;
+        chunk_read = fread(chunk_dst, sizeof(char), chunk_size, file);
+        crc = pfu_crc32(crc, chunk_dst, chunk_read);
+        bytes_read += chunk_read;
+        if (chunk_read < chunk_size)
+          break;
       }
+      fclose(file);
+      if (hash)
+        *hash = crc;
 
       return bytes_read;
     }
@@ -126,178 +153,252 @@ static int pfu_load_file(void *dst, unsigned size, const char *path, unsigned so
 
 static int pfu_controller_pak_write(const char *path, unsigned source)
 {
-  if (!cpakfs_mount(JOYPAD_PORT_1, "cpak1:/"))
-  {
-    FILE *output_file;
-    u8 rom_data[0x4000];
-    u8 compressed_rom_data[0x4000];
-    unsigned size;
-    pfu_compression_header_t header;
-    char formatted_path[64];
-    char temp_path[32] = { 0 };
-    size_t bytes_written = 0;
-    cpakfs_stats_t stats;
-    int pages_needed;
-    unsigned i, j, last_char_was_space = 0;
-
-    /* Format Controller Pak if needed */
-    if (cpakfs_fsck(JOYPAD_PORT_1, false, NULL))
-      pfu_message_switch(PFU_STATE_MENU,
-        "The Controller Pak needs to be formatted.\n\n"
-        "Please format it in a compatible game and try again.");
-
-    /* Load the file to be copied to Controller Pak */
-    header.original_size = pfu_load_file(rom_data, sizeof(rom_data), path, source);
-    if (!header.original_size)
-    {
-      pfu_message_switch(PFU_STATE_MENU,
-        "Failed to load ROM data.\n\n"
-        "Please check the file path and try again.");
-      goto error;
-    }
-
-    /* Compress the file */
-    header.compressed_size = fastlz_compress_level(2, rom_data, header.original_size, compressed_rom_data);
-    if (!header.compressed_size)
-    {
-      pfu_message_switch(PFU_STATE_MENU,
-        "Failed to compress ROM data.");
-      goto error;
-    }
+  const cpakfs_stats_t *stats;
+  char temp_path[32] = { 0 };
+  unsigned i, j, last_char_was_space = 0;
+  unsigned size, pages_needed, notes_needed;
+  pfu_cpak_error error;
+  u8 *rom_data;
+
+  if (!pfu_cpak_mount())
+  {
+    pfu_message_switch(PFU_STATE_MENU,
+      "Press F Ultra requires a Controller Pak to be inserted in\n"
+      "the first joypad port to save ROMs to it.\n\n"
+      "Please insert a Controller Pak and try again.");
+    return 0;
+  }
 
-    /* Add space for header */
-    size = header.compressed_size + sizeof(pfu_compression_header_t);
+  rom_data = pfu_malloc(PFU_MEMORY_LOADER, PFU_ROM_MAX_SIZE);
+  if (!rom_data)
+  {
+    pfu_message_switch(PFU_STATE_MENU,
+      "Not enough memory to copy ROM data.");
+    return 0;
+  }
 
-    /* Check if the Controller Pak has space to hold it */
-    cpakfs_get_stats(JOYPAD_PORT_1, &stats);
-    pages_needed = size % 256 == 0 ? size / 256 : size / 256 + 1;
-    if (stats.pages.used + pages_needed > stats.pages.total ||
-        stats.notes.used + 1 > stats.notes.total)
-    {
-      signed pages_free, notes_free;
+  /* Load the file to be copied to Controller Pak */
+  size = pfu_load_file(rom_data, PFU_ROM_MAX_SIZE, path, source, NULL);
+  if (!size)
+  {
+    pfu_message_switch(PFU_STATE_MENU,
+      "Failed to load ROM data.\n\n"
+      "Please check the file path and try again.");
+    pfu_free(rom_data);
+    return 0;
+  }
 
-      pages_free = stats.pages.total - stats.pages.used;
-      notes_free = stats.notes.total - stats.notes.used;
-      pfu_message_switch(PFU_STATE_MENU, "Not enough space on Controller Pak.\n\n"
-        "Required: %i pages, 1 note\n"
-        "Available: %i pages, %i notes\n\n"
-        "Please free some space and try again.",
-        pages_needed, pages_free, notes_free);
+  /**
+   * Format ROM name to Controller Pak format: 16 characters, uppercase
+   * letters and spaces only. Trim any tags like (USA).
+   */
+  for (i = 0, j = 0; i < 256 && path[i] != '\0' && j < 16 && path[i] != '(' && path[i] != '.'; i++)
+  {
+    char c = path[i];
 
-      goto error;
-    }
+    /* Convert lowercase letters to uppercase */
+    if (c >= 'a' && c <= 'z')
+      c -= 0x20;
 
-    /**
-     * Format ROM name to Controller Pak format: 16 characters, uppercase
-     * letters and spaces only. Trim any tags like (USA).
-     */
-    for (i = 0, j = 0; i < 256 && path[i] != '\0' && j < 16 && path[i] != '(' && path[i] != '.'; i++)
+    /* Acceptable characters: A-Z, 0-9, space, hyphen */
+    if ((c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '-' || c == ' ')
     {
-      char c = path[i];
-
-      /* Convert lowercase letters to uppercase */
-      if (c >= 'a' && c <= 'z')
-        c -= 0x20;
-
-      /* Acceptable characters: A-Z, 0-9, space, hyphen */
-      if ((c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '-' || c == ' ')
+      /* Collapse multiple spaces */
+      if (c == ' ')
       {
-        /* Collapse multiple spaces */
-        if (c == ' ')
-        {
-          if (last_char_was_space)
-            continue;
-          last_char_was_space = 1;
-        }
-        else
-          last_char_was_space = 0;
-
-        temp_path[j++] = c;
+        if (last_char_was_space)
+          continue;
+        last_char_was_space = 1;
       }
       else
+        last_char_was_space = 0;
+
+      temp_path[j++] = c;
+    }
+    else
+    {
+      /* Replace other characters with space, but avoid multiple spaces */
+      if (!last_char_was_space)
       {
-        /* Replace other characters with space, but avoid multiple spaces */
-        if (!last_char_was_space)
-        {
-          temp_path[j++] = ' ';
-          last_char_was_space = 1;
-        }
+        temp_path[j++] = ' ';
+        last_char_was_space = 1;
       }
     }
-    temp_path[j] = '\0';
-
-    /* Remove trailing space if present */
-    if (j > 0 && temp_path[j - 1] == ' ')
-      temp_path[j - 1] = '\0';
-    snprintf(formatted_path, sizeof(formatted_path), "%s/%s.CHF", PFU_PATH_CONTROLLER_PAK, temp_path);
+  }
+  temp_path[j] = '\0';
 
-    /* Create new file on Controller Pak */
-    output_file = fopen(formatted_path, "wb");
-    if (!output_file || ferror(output_file))
-    {
-      pfu_message_switch(PFU_STATE_MENU,
-        "Failed to open file for writing:\n%s", strerror(errno));
-      goto error;
-    }
+  /* Remove trailing space if present */
+  if (j > 0 && temp_path[j - 1] == ' ')
+    temp_path[j - 1] = '\0';
 
-    /* Write ROM to the file */
-    header.magic = pfu_compression_magic;
-    bytes_written += fwrite(&header, 1, sizeof(header), output_file);
-    bytes_written += fwrite(compressed_rom_data, sizeof(char), header.compressed_size, output_file);
-    fclose(output_file);
-    if (bytes_written != size)
-    {
-      pfu_message_switch(PFU_STATE_MENU,
-        "Failed to write data to file:\n%s\n\n"
-        "Expected: %u\nWritten: %u", strerror(errno), size, bytes_written);
-      goto error;
-    }
-    else
-    {
-      unsigned pages_free, notes_free;
+  error = pfu_cpak_save(temp_path, rom_data, size, &pages_needed, &notes_needed);
+  pfu_free(rom_data);
+  stats = pfu_cpak_stats();
 
-      cpakfs_get_stats(JOYPAD_PORT_1, &stats);
-      pages_free = stats.pages.total - stats.pages.used;
-      notes_free = stats.notes.total - stats.notes.used;
-      pfu_message_switch(PFU_STATE_MENU,
-        "ROM successfully saved to Controller Pak.\n"
-        "You can now load it from the ROMs menu.\n\n"
-        "Name: %s\n"
-        "Size: 1 note, %i pages\n\n"
-        "Remaining space on Controller Pak:\n"
-        "Pages free: %i / %i\n"
-        "Notes free: %i / %i",
-        formatted_path, pages_needed, pages_free,
-        stats.pages.total, notes_free, stats.notes.total);
-      cpakfs_unmount(JOYPAD_PORT_1);
-
-      return 1;
-    }
+  switch (error)
+  {
+  case PFU_CPAK_OK:
+    pfu_message_switch(PFU_STATE_MENU,
+      "ROM successfully saved to Controller Pak.\n"
+      "You can now load it from the ROMs menu.\n\n"
+      "Name: %s/%s.CHF\n"
+      "Size: %u note(s), %u pages\n\n"
+      "Remaining space on Controller Pak:\n"
+      "Pages free: %i / %i\n"
+      "Notes free: %i / %i",
+      PFU_PATH_CONTROLLER_PAK, temp_path, notes_needed, pages_needed,
+      stats ? stats->pages.total - stats->pages.used : 0,
+      stats ? stats->pages.total : 0,
+      stats ? stats->notes.total - stats->notes.used : 0,
+      stats ? stats->notes.total : 0);
+    return 1;
+  case PFU_CPAK_ERROR_NO_PAK:
+    pfu_message_switch(PFU_STATE_MENU,
+      "Press F Ultra requires a Controller Pak to be inserted in\n"
+      "the first joypad port to save ROMs to it.\n\n"
+      "Please insert a Controller Pak and try again.");
+    break;
+  case PFU_CPAK_ERROR_UNFORMATTED:
+    pfu_message_switch(PFU_STATE_MENU,
+      "The Controller Pak needs to be formatted.\n\n"
+      "Please format it in a compatible game and try again.");
+    break;
+  case PFU_CPAK_ERROR_MEMORY:
+    pfu_message_switch(PFU_STATE_MENU,
+      "Not enough memory to copy ROM data.");
+    break;
+  case PFU_CPAK_ERROR_COMPRESS:
+    pfu_message_switch(PFU_STATE_MENU,
+      "Failed to compress ROM data.");
+    break;
+  case PFU_CPAK_ERROR_NO_SPACE:
+    pfu_message_switch(PFU_STATE_MENU, "Not enough space on Controller Pak.\n\n"
+      "Required: %u pages, %u note(s)\n"
+      "Available: %i pages, %i notes\n\n"
+      "Please free some space and try again.",
+      pages_needed, notes_needed,
+      stats ? stats->pages.total - stats->pages.used : 0,
+      stats ? stats->notes.total - stats->notes.used : 0);
+    break;
+  case PFU_CPAK_ERROR_OPEN:
+    pfu_message_switch(PFU_STATE_MENU,
+      "Failed to open file for writing:\n%s", strerror(errno));
+    break;
+  default:
+    pfu_message_switch(PFU_STATE_MENU,
+      "Failed to write data to file:\n%s", strerror(errno));
   }
-  pfu_message_switch(PFU_STATE_MENU,
-    "Press F Ultra requires a Controller Pak to be inserted in\n"
-    "the first joypad port to save ROMs to it.\n\n"
-    "Please insert a Controller Pak and try again.");
-error:
-  cpakfs_unmount(JOYPAD_PORT_1);
+
   return 0;
 }
 
-static int pfu_load_rom(unsigned address, const char *path, unsigned source)
+/**
+ * Loads a ROM into guest memory. The data is written through the system bus
+ * rather than directly into memory, so devices mapped by ROMC see the new
+ * contents.
+ * Recently loaded ROMs are copied from the RAM cache instead of their source.
+ */
+static int pfu_load_rom(unsigned address, const char *path, unsigned source,
+                        u32 *hash)
 {
+  const unsigned size = PFU_ROM_MAX_SIZE;
+  u8 *buffer;
+  int bytes_read;
+
   if (source == PFU_SOURCE_INVALID || source >= PFU_SOURCE_SIZE)
     return 0;
-  else
-    return pfu_load_file(&emu.system.memory[address], 0x4000, path, source);
+
+  buffer = pfu_malloc(PFU_MEMORY_LOADER, size);
+  if (!buffer)
+  {
+    pfu_message_switch(PFU_STATE_MENU, "Not enough memory to load ROM data.");
+    return 0;
+  }
+  bytes_read = pfu_romcache_load(path, source, buffer, size, hash);
+  if (!bytes_read)
+  {
+    u32 crc = 0;
+
+    bytes_read = pfu_load_file(buffer, size, path, source, &crc);
+    if (bytes_read > 0)
+      pfu_romcache_store(path, source, buffer, bytes_read, crc);
+    if (hash)
+      *hash = crc;
+  }
+  if (bytes_read > 0)
+    f8_write(&emu.system, address, buffer, bytes_read);
+  pfu_free(buffer);
+
+  /* The system font is patched into the BIOS, so keep the chosen one */
+  if (bytes_read > 0 && address < 0x0800 &&
+      pfu_menu_get_setting(PFU_ENTRY_KEY_FONT))
+    pfu_menu_set_setting(PFU_ENTRY_KEY_FONT,
+                         pfu_menu_get_setting(PFU_ENTRY_KEY_FONT));
+
+  return bytes_read;
+}
+
+/* Settings the game database can override per title */
+static const pfu_entry_key pfu_gamedb_keys[] = {
+  PFU_ENTRY_KEY_SYSTEM_MODEL,
+  PFU_ENTRY_KEY_FONT,
+  PFU_ENTRY_KEY_SWAP_CONTROLLERS
+};
+
+/**
+ * Applies the game database settings for a loaded ROM. The settings a title
+ * can override are first returned to the values the user chose, so none of
+ * a previous title's overrides carry over. A hash of 0 means no ROM.
+ */
+static void pfu_menu_apply_gamedb(u32 hash)
+{
+  pfu_gamedb_entry_t entry;
+  unsigned i;
+
+  for (i = 0; i < sizeof(pfu_gamedb_keys) / sizeof(pfu_gamedb_keys[0]); i++)
+    if (pfu_menu_get_setting(pfu_gamedb_keys[i]) !=
+        pfu_config_setting(pfu_gamedb_keys[i]))
+      pfu_menu_set_setting(pfu_gamedb_keys[i],
+                           pfu_config_setting(pfu_gamedb_keys[i]));
+  if (!hash || !pfu_gamedb_find(hash, &entry))
+    return;
+
+  if (entry.clock != PFU_GAMEDB_UNSET)
+    pfu_menu_set_setting(PFU_ENTRY_KEY_SYSTEM_MODEL, entry.clock);
+  if (entry.font != PFU_GAMEDB_UNSET)
+    pfu_menu_set_setting(PFU_ENTRY_KEY_FONT, entry.font);
+  if (entry.swap != PFU_GAMEDB_UNSET)
+    pfu_menu_set_setting(PFU_ENTRY_KEY_SWAP_CONTROLLERS, entry.swap);
+
+  if (entry.flags & PFU_GAMEDB_FLAG_ISSUES)
+    pfu_message_switch(PFU_STATE_EMU,
+      "This title is known to have emulation issues.\n\n"
+      "ROM hash: %08lX", (unsigned long)hash);
+}
+
+/**
+ * Suspends the running session before it is replaced by another. The
+ * snapshot is written out now, rather than over the next frames, so it is
+ * complete before the new session is launched.
+ */
+static void pfu_menu_suspend_now(void)
+{
+  pfu_suspend_request();
+  pfu_suspend_finish();
 }
 
 static void pfu_menu_entry_back(void)
 {
   unsigned dummy = 0;
 
+  pfu_menu_suspend_now();
   f8_write(&emu.system, 0x0800, &dummy, sizeof(dummy));
+  frontend.rom_hash = 0;
+  pfu_menu_apply_gamedb(0);
   pfu_emu_switch();
   pressf_reset(&emu.system);
+  pfu_bootcache_launch();
+  pfu_suspend_launch(NULL);
 }
 
 static void pfu_menu_entry_bool(pfu_menu_entry_t *entry, bool value)
@@ -312,12 +413,43 @@ static void pfu_menu_entry_bool(pfu_menu_entry_t *entry, bool value)
   case PFU_ENTRY_KEY_PIXEL_PERFECT:
     emu.video_scaling = value ? PFU_SCALING_1_1 : PFU_SCALING_4_3;
     break;
+  case PFU_ENTRY_KEY_DEBUG_OVERLAY:
+    pfu_overlay_set_enabled(value);
+    break;
+  case PFU_ENTRY_KEY_AUTOLOAD:
+    break;
+  case PFU_ENTRY_KEY_BOOTCACHE_SD:
+    pfu_bootcache_set_persist(value);
+    break;
   default:
     return;
   }
   entry->current_value = value;
 }
 
+static const unsigned long pfu_clock_speeds[] = {
+  F8_CLOCK_CHANNEL_F_NTSC,
+  F8_CLOCK_CHANNEL_F_PAL_GEN_1,
+  F8_CLOCK_CHANNEL_F_PAL_GEN_2
+};
+
+/* Overclock multipliers, in halves */
+static const unsigned pfu_overclock_halves[PFU_OVERCLOCK_SIZE] = { 2, 3, 4, 6 };
+
+/**
+ * Sets the emulated CPU clock from a system model and overclock. The core
+ * runs a frame's worth of cycles at this clock per pressf_run, so frames
+ * still come at the video rate, only with more instructions in each. The
+ * beeper is told too, so tones keep their pitch.
+ */
+static void pfu_menu_set_clock(unsigned model, pfu_overclock_type overclock)
+{
+  emu.system.settings.f3850_clock_speed =
+    pfu_clock_speeds[model] * pfu_overclock_halves[overclock] / 2;
+  emu.overclock = overclock;
+  pfu_audio_set_overclock(pfu_overclock_halves[overclock]);
+}
+
 static void pfu_menu_entry_choice(pfu_menu_entry_t *entry, signed value)
 {
   if (!entry)
@@ -325,32 +457,56 @@ static void pfu_menu_entry_choice(pfu_menu_entry_t *entry, signed value)
   else switch (entry->key)
   {
   case PFU_ENTRY_KEY_SYSTEM_MODEL:
+    if (value < 0 ||
+        value >= (signed)(sizeof(pfu_clock_speeds) / sizeof(pfu_clock_speeds[0])))
+      return;
+    pfu_menu_set_clock(value, emu.overclock);
+    break;
+  case PFU_ENTRY_KEY_OVERCLOCK:
+    if (value < 0 || value >= PFU_OVERCLOCK_SIZE)
+      return;
+    pfu_menu_set_clock(pfu_menu_get_setting(PFU_ENTRY_KEY_SYSTEM_MODEL), value);
+    break;
+  case PFU_ENTRY_KEY_FONT:
     switch (value)
     {
     case 0:
-      emu.system.settings.f3850_clock_speed = F8_CLOCK_CHANNEL_F_NTSC;
+      font_load(&emu.system, FONT_FAIRCHILD);
       break;
     case 1:
-      emu.system.settings.f3850_clock_speed = F8_CLOCK_CHANNEL_F_PAL_GEN_1;
+      font_load(&emu.system, FONT_CUTE);
       break;
     case 2:
-      emu.system.settings.f3850_clock_speed = F8_CLOCK_CHANNEL_F_PAL_GEN_2;
+      font_load(&emu.system, FONT_SKINNY);
       break;
     default:
       return;
     }
     break;
-  case PFU_ENTRY_KEY_FONT:
+  case PFU_ENTRY_KEY_AUDIO_RATE:
+    if (value < 0 || value >= PFU_AUDIO_RATE_SIZE)
+      return;
+    pfu_audio_init(value);
+    break;
+  case PFU_ENTRY_KEY_AUDIO_SYNTH:
+    if (value < 0 || value >= PFU_AUDIO_SYNTH_SIZE)
+      return;
+    pfu_audio_set_synth(value);
+    break;
+  case PFU_ENTRY_KEY_FRAME_DUMP:
     switch (value)
     {
     case 0:
-      font_load(&emu.system, FONT_FAIRCHILD);
+      pfu_capture_set_interval(0);
       break;
     case 1:
-      font_load(&emu.system, FONT_CUTE);
+      pfu_capture_set_interval(60);
       break;
     case 2:
-      font_load(&emu.system, FONT_SKINNY);
+      pfu_capture_set_interval(30);
+      break;
+    case 3:
+      pfu_capture_set_interval(pfu_capture_min_interval());
       break;
     default:
       return;
@@ -362,13 +518,74 @@ static void pfu_menu_entry_choice(pfu_menu_entry_t *entry, signed value)
   entry->current_value = value;
 }
 
+signed pfu_menu_get_setting(pfu_entry_key key)
+{
+  int i;
+
+  for (i = 0; i < pfu_menus.settings.entry_count; i++)
+    if (pfu_menus.settings.entries[i].key == key)
+      return pfu_menus.settings.entries[i].current_value;
+
+  return 0;
+}
+
+void pfu_menu_set_setting(pfu_entry_key key, signed value)
+{
+  int i;
+
+  for (i = 0; i < pfu_menus.settings.entry_count; i++)
+  {
+    pfu_menu_entry_t *entry = &pfu_menus.settings.entries[i];
+
+    if (entry->key != key)
+      continue;
+    else if (entry->type == PFU_ENTRY_TYPE_BOOL)
+      pfu_menu_entry_bool(entry, value ? true : false);
+    else if (entry->type == PFU_ENTRY_TYPE_CHOICE)
+      pfu_menu_entry_choice(entry, value);
+    return;
+  }
+}
+
+bool pfu_menu_key_persists(pfu_entry_key key)
+{
+  return key != PFU_ENTRY_KEY_FRAME_DUMP && key != PFU_ENTRY_KEY_DEBUG_OVERLAY;
+}
+
+/**
+ * Applies a change made by the user in the settings menu and records it to
+ * be stored. Values from the game database or a suspend file are applied
+ * with pfu_menu_set_setting instead, so they are never recorded.
+ */
+static void pfu_menu_change(pfu_menu_entry_t *entry, signed value)
+{
+  signed previous = entry->current_value;
+
+  if (entry->type == PFU_ENTRY_TYPE_BOOL)
+    pfu_menu_entry_bool(entry, value ? true : false);
+  else if (entry->type == PFU_ENTRY_TYPE_CHOICE)
+    pfu_menu_entry_choice(entry, value);
+  if (entry->current_value != previous && pfu_menu_key_persists(entry->key))
+    pfu_config_set_setting(entry->key, entry->current_value);
+}
+
 static void pfu_menu_entry_file(pfu_menu_entry_t *entry)
 {
   if (entry)
   {
-    pfu_load_rom(0x0800, entry->title, entry->current_value);
+    u32 hash;
+
+    pfu_menu_suspend_now();
+    if (pfu_load_rom(0x0800, entry->title, entry->current_value, &hash))
+      frontend.rom_hash = hash;
+    else
+      frontend.rom_hash = 0;
+    pfu_menu_apply_gamedb(frontend.rom_hash);
     pfu_emu_switch();
     pressf_reset(&emu.system);
+    pfu_bootcache_launch();
+    pfu_suspend_launch(entry->title);
+    pfu_config_set_rom(entry->title, entry->current_value);
   }
 }
 
@@ -376,11 +593,11 @@ static void pfu_menu_init_settings(void)
 {
   pfu_menu_ctx_t menu;
   pfu_menu_entry_t *entry;
-  const unsigned entry_count = 4;
+  const unsigned entry_count = 12;
   unsigned i = 0;
 
   memset(&menu, 0, sizeof(menu));
-  menu.entries = calloc(entry_count, sizeof(pfu_menu_entry_t));
+  menu.entries = pfu_calloc(PFU_MEMORY_MENU, entry_count, sizeof(pfu_menu_entry_t));
   menu.entry_count = entry_count;
 
   snprintf(menu.menu_title, sizeof(menu.menu_title), "%s", "Press F Ultra - Settings");
@@ -407,6 +624,16 @@ static void pfu_menu_init_settings(void)
   snprintf(entry->choices[2], sizeof(entry->choices[2]), "%s", "PAL Gen II (1.97 MHz)");
   i++;
 
+  entry = &menu.entries[i];
+  entry->key = PFU_ENTRY_KEY_OVERCLOCK;
+  entry->type = PFU_ENTRY_TYPE_CHOICE;
+  snprintf(entry->title, sizeof(entry->title), "%s", "CPU overclock");
+  snprintf(entry->choices[0], sizeof(entry->choices[0]), "%s", "Off");
+  snprintf(entry->choices[1], sizeof(entry->choices[1]), "%s", "1.5x");
+  snprintf(entry->choices[2], sizeof(entry->choices[2]), "%s", "2x");
+  snprintf(entry->choices[3], sizeof(entry->choices[3]), "%s", "3x");
+  i++;
+
   entry = &menu.entries[i];
   entry->key = PFU_ENTRY_KEY_FONT;
   entry->type = PFU_ENTRY_TYPE_CHOICE;
@@ -416,6 +643,58 @@ static void pfu_menu_init_settings(void)
   snprintf(entry->choices[2], sizeof(entry->choices[2]), "%s", "Skinny");
   i++;
 
+  entry = &menu.entries[i];
+  entry->key = PFU_ENTRY_KEY_AUDIO_RATE;
+  entry->type = PFU_ENTRY_TYPE_CHOICE;
+  snprintf(entry->title, sizeof(entry->title), "%s", "Audio sample rate");
+  snprintf(entry->choices[0], sizeof(entry->choices[0]), "%s", "44100 Hz");
+  snprintf(entry->choices[1], sizeof(entry->choices[1]), "%s", "32000 Hz");
+  snprintf(entry->choices[2], sizeof(entry->choices[2]), "%s", "22050 Hz");
+  i++;
+
+  entry = &menu.entries[i];
+  entry->key = PFU_ENTRY_KEY_AUDIO_SYNTH;
+  entry->type = PFU_ENTRY_TYPE_CHOICE;
+  snprintf(entry->title, sizeof(entry->title), "%s", "Audio synthesis");
+  snprintf(entry->choices[0], sizeof(entry->choices[0]), "%s", "Legacy");
+  snprintf(entry->choices[1], sizeof(entry->choices[1]), "%s", "Band-limited");
+  i++;
+
+  entry = &menu.entries[i];
+  entry->key = PFU_ENTRY_KEY_FRAME_DUMP;
+  entry->type = PFU_ENTRY_TYPE_CHOICE;
+  snprintf(entry->title, sizeof(entry->title), "%s", "Frame dump to SD Card");
+  snprintf(entry->choices[0], sizeof(entry->choices[0]), "%s", "Off");
+  snprintf(entry->choices[1], sizeof(entry->choices[1]), "%s", "Every 60th frame");
+  snprintf(entry->choices[2], sizeof(entry->choices[2]), "%s", "Every 30th frame");
+  snprintf(entry->choices[3], sizeof(entry->choices[3]), "Every %uth frame",
+           pfu_capture_min_interval());
+  i++;
+
+  entry = &menu.entries[i];
+  entry->key = PFU_ENTRY_KEY_DEBUG_OVERLAY;
+  entry->type = PFU_ENTRY_TYPE_BOOL;
+  snprintf(entry->title, sizeof(entry->title), "%s", "Debug overlay");
+  i++;
+
+  entry = &menu.entries[i];
+  entry->key = PFU_ENTRY_KEY_AUTOLOAD;
+  entry->type = PFU_ENTRY_TYPE_BOOL;
+  snprintf(entry->title, sizeof(entry->title), "%s", "Load last ROM at startup");
+  i++;
+
+  entry = &menu.entries[i];
+  entry->key = PFU_ENTRY_KEY_BOOTCACHE_SD;
+  entry->type = PFU_ENTRY_TYPE_BOOL;
+  snprintf(entry->title, sizeof(entry->title), "%s", "Save boot snapshots to SD Card");
+  i++;
+
+  entry = &menu.entries[i];
+  entry->key = PFU_ENTRY_KEY_SUSPEND;
+  entry->type = PFU_ENTRY_TYPE_BACK;
+  snprintf(entry->title, sizeof(entry->title), "%s", "Suspend game to SD Card");
+  i++;
+
   if (i != entry_count)
   {
     pfu_error_switch(
@@ -424,61 +703,222 @@ static void pfu_menu_init_settings(void)
     return;
   }
 
-  emu.menu_settings = menu;
+  pfu_menus.settings = menu;
 }
 
-static void pfu_menu_init_roms_source(pfu_menu_ctx_t *menu, const char *src_path, int src)
+/* Characters that can be added to a ROM search, in order */
+static const char pfu_search_characters[] = " 0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+
+/**
+ * The visible part of the ROM menu. While searching, the C buttons edit a
+ * name prefix, and the menu shows only ROMs starting with it.
+ */
+typedef struct
+{
+  bool searching;
+  char prefix[32];
+  unsigned length;
+  char candidate;
+
+  /* Range of the sorted ROM list matching the prefix */
+  unsigned first;
+  unsigned last;
+} pfu_menu_view_t;
+
+static pfu_menu_view_t pfu_view = { false, "", 0, 'A', 0, 0 };
+
+/* Time spent walking the SD Card per menu frame, in microseconds */
+#define PFU_SCAN_SLICE_US 4000
+
+/**
+ * State of the ROM menu scan. The Controller Pak and bundled ROMs are listed
+ * up front from their caches, then the SD Card is walked in time-limited
+ * slices between menu frames, so the menu is usable while it fills.
+ */
+typedef struct
 {
+  bool active;
+
+  /* Whether BIOS are still to be looked up by name, in the first slice */
+  bool bios_lookup;
+
+  /* Whether dir holds an SD Card entry not yet added */
+  bool pending;
   dir_t dir;
-  int err = dir_findfirst(src_path, &dir); 
 
-  while (!err)
+  u32 start;
+  u32 interactive_ticks;
+  u32 complete_ticks;
+  bool logged;
+} pfu_menu_scan_t;
+
+static pfu_menu_scan_t pfu_scan;
+
+static void pfu_menu_scan_entry(const dir_t *dir, int src)
+{
+  if (dir->d_type != DT_REG)
+    return;
+
+  /* Load BIOS if found */
+  if (!strncmp(dir->d_name, "sl31253.bin", 8))
   {
-    if (dir.d_type == DT_REG)
-    {
-      /* Load BIOS if found */
-      if (!strncmp(dir.d_name, "sl31253.bin", 8))
-      {
-        if (!emu.bios_a_loaded)
-          emu.bios_a_loaded = pfu_load_rom(0x0000, dir.d_name, src);
-      }
-      else if (!strncmp(dir.d_name, "sl31254.bin", 8))
-      {
-        if (!emu.bios_b_loaded)
-          emu.bios_b_loaded = pfu_load_rom(0x0400, dir.d_name, src);
-      }
-      else if (strlen(dir.d_name) && dir.d_name[0] != '.' &&
-               (src != PFU_SOURCE_CONTROLLER_PAK || strstr(dir.d_name, ".CHF")))
-      {
-        /* List all other files */
-        const char *basename = strrchr(dir.d_name, '/');
-
-        if (basename)
-          basename++;
-        else
-          basename = dir.d_name;
-
-        snprintf(menu->entries[menu->entry_count].title,
-                 sizeof(menu->entries[menu->entry_count].title),
-                 "%s", basename);
-        menu->entries[menu->entry_count].title[sizeof(menu->entries[menu->entry_count].title) - 1] = '\0';
-        menu->entries[menu->entry_count].type = PFU_ENTRY_TYPE_FILE;
-        menu->entries[menu->entry_count].current_value = src;
-        menu->entry_count++;
-      }
-    }
-    err = dir_findnext(src_path, &dir); 
+    if (!frontend.bios_a_loaded)
+      frontend.bios_a_loaded = pfu_load_rom(0x0000, dir->d_name, src, NULL);
+  }
+  else if (!strncmp(dir->d_name, "sl31254.bin", 8))
+  {
+    if (!frontend.bios_b_loaded)
+      frontend.bios_b_loaded = pfu_load_rom(0x0400, dir->d_name, src, NULL);
+  }
+  else if (strlen(dir->d_name) && dir->d_name[0] != '.')
+  {
+    /* List all other files */
+    const char *basename = strrchr(dir->d_name, '/');
+
+    if (basename)
+      basename++;
+    else
+      basename = dir->d_name;
+    pfu_romlist_add(basename, src);
   }
 }
 
+/**
+ * Updates the ROM menu for the current search filter and scan progress.
+ * Rows after "Boot to BIOS..." show the filtered range of the sorted ROM
+ * list, so filtering never copies entries.
+ */
+static void pfu_menu_roms_view(void)
+{
+  pfu_menu_ctx_t *menu = &pfu_menus.roms;
+
+  pfu_romlist_find(pfu_view.prefix, &pfu_view.first, &pfu_view.last);
+  menu->entry_count = 1 + pfu_view.last - pfu_view.first;
+  if (menu->cursor >= menu->entry_count)
+    menu->cursor = menu->entry_count - 1;
+
+  if (pfu_view.searching)
+    snprintf(menu->menu_subtitle, sizeof(menu->menu_subtitle),
+             "Search: %s[%c]  %u matches", pfu_view.prefix,
+             pfu_view.candidate, pfu_view.last - pfu_view.first);
+  else if (pfu_scan.active)
+    snprintf(menu->menu_subtitle, sizeof(menu->menu_subtitle),
+             "Scanning SD Card... %u entries", pfu_romlist_count());
+  else if (pfu_view.length)
+    snprintf(menu->menu_subtitle, sizeof(menu->menu_subtitle),
+             "Showing \"%s\". Press Start to search.", pfu_view.prefix);
+  else if (joypad_get_accessory_type(JOYPAD_PORT_1) == JOYPAD_ACCESSORY_TYPE_CONTROLLER_PAK)
+    snprintf(menu->menu_subtitle, sizeof(menu->menu_subtitle), "%s", "Press A to load, or Z to copy to Controller Pak.");
+  else
+    snprintf(menu->menu_subtitle, sizeof(menu->menu_subtitle), "%s", "Select a ROM. Press A to load.");
+}
+
+/**
+ * Returns the entry shown in a menu row. ROM menu rows after the first are
+ * read from the sorted ROM list into a scratch entry, valid until the next
+ * call.
+ */
+static pfu_menu_entry_t *pfu_menu_row(pfu_menu_ctx_t *menu, int row)
+{
+  static pfu_menu_entry_t file;
+  unsigned position;
+
+  if (menu != &pfu_menus.roms || row < 1)
+    return &menu->entries[row];
+  position = pfu_view.first + row - 1;
+  snprintf(file.title, sizeof(file.title), "%s", pfu_romlist_name(position));
+  file.type = PFU_ENTRY_TYPE_FILE;
+  file.current_value = pfu_romlist_source(position);
+
+  return &file;
+}
+
+/**
+ * Logs how long the ROM menu took to become usable and to finish filling,
+ * once both are known.
+ */
+static void pfu_menu_scan_log(void)
+{
+  if (pfu_scan.logged || !pfu_scan.interactive_ticks || !pfu_scan.complete_ticks)
+    return;
+  pfu_stats_log("menu interactive_us=%lu complete_us=%lu entries=%i",
+                (unsigned long)TICKS_TO_US(pfu_scan.interactive_ticks),
+                (unsigned long)TICKS_TO_US(pfu_scan.complete_ticks),
+                pfu_romlist_count());
+  pfu_scan.logged = true;
+}
+
+static void pfu_menu_scan_complete(void)
+{
+  pfu_scan.active = false;
+  pfu_scan.complete_ticks = get_ticks() - pfu_scan.start;
+  pfu_menu_scan_log();
+
+  /* Fail if BIOS are not located */
+  if (!frontend.bios_a_loaded || !frontend.bios_b_loaded)
+    pfu_error_switch(
+      "Press F Ultra requires Channel F BIOS data to be stored on\n"
+      "the SD Card in the \"press-f\" directory.\n\n"
+      "Please include both the $03sl31253.bin$01 and "
+      "$03sl31254.bin$01 BIOS images.\n\n"
+      "Alternatively, this data can be compiled in statically.\n\n"
+      "See https://github.com/celerizer/Press-F-Ultra for details.");
+}
+
+/**
+ * Continues walking the SD Card for up to the given time, adding entries to
+ * the ROM menu as they are found.
+ */
+static void pfu_menu_scan_step(unsigned budget_us)
+{
+  u32 start = get_ticks();
+
+  if (!pfu_scan.active)
+    return;
+  if (pfu_scan.bios_lookup)
+  {
+    pfu_scan.bios_lookup = false;
+    pfu_menu_load_bios();
+  }
+  while (pfu_scan.pending)
+  {
+    pfu_menu_scan_entry(&pfu_scan.dir, PFU_SOURCE_SD_CARD);
+    pfu_scan.pending = !dir_findnext(PFU_PATH_SD_CARD, &pfu_scan.dir);
+    if (TICKS_TO_US(get_ticks() - start) >= budget_us)
+      break;
+  }
+
+  if (!pfu_scan.pending)
+    pfu_menu_scan_complete();
+}
+
+/**
+ * Returns whether both BIOS are loaded, first finishing the scan if they
+ * have not been found yet.
+ */
+static bool pfu_menu_bios_ready(void)
+{
+  if (!frontend.bios_a_loaded || !frontend.bios_b_loaded)
+    pfu_menu_scan_step(~0u);
+
+  return frontend.bios_a_loaded && frontend.bios_b_loaded;
+}
+
 static void pfu_menu_init_roms(void)
 {
   pfu_menu_ctx_t menu;
-
-  if (emu.menu_roms.entries)
-    free(emu.menu_roms.entries);
+  unsigned i;
+
+  pfu_scan.start = get_ticks();
+  pfu_scan.interactive_ticks = 0;
+  pfu_scan.complete_ticks = 0;
+  pfu_scan.logged = false;
+  if (pfu_menus.roms.entries)
+    pfu_free(pfu_menus.roms.entries);
   memset(&menu, 0, sizeof(menu));
-  menu.entries = calloc(PFU_MENU_MAX_ENTRIES, sizeof(pfu_menu_entry_t));
+  menu.entries = pfu_calloc(PFU_MEMORY_MENU, 1, sizeof(pfu_menu_entry_t));
+  pfu_romlist_clear();
+  snprintf(menu.menu_title, sizeof(menu.menu_title), "%s", "Press F Ultra - ROMs");
 
   /* Set up dummy file entry to not load a ROM */
   snprintf(menu.entries[0].title, sizeof(menu.entries[0].title), "%s", "Boot to BIOS...");
@@ -486,51 +926,115 @@ static void pfu_menu_init_roms(void)
   menu.entries[0].key = PFU_ENTRY_KEY_NONE;
   menu.entry_count = 1;
 
-  if (!cpakfs_mount(JOYPAD_PORT_1, "cpak1:/"))
-    pfu_menu_init_roms_source(&menu, "cpak1:/", PFU_SOURCE_CONTROLLER_PAK);
-  cpakfs_unmount(JOYPAD_PORT_1);
-  pfu_menu_init_roms_source(&menu, PFU_PATH_ROMFS, PFU_SOURCE_ROMFS);
-  pfu_menu_init_roms_source(&menu, PFU_PATH_SD_CARD, PFU_SOURCE_SD_CARD);
+  /* The Controller Pak directory is cached while it stays inserted */
+  for (i = 0; i < pfu_cpak_rom_count(); i++)
+    pfu_romlist_add(pfu_cpak_rom_name(i), PFU_SOURCE_CONTROLLER_PAK);
 
-  /* Fail if BIOS are not located */
-  if (emu.bios_a_loaded && emu.bios_b_loaded)
+  /* Bundled ROMs are listed from the pack manifest */
+  for (i = 0; i < pfu_romfs_count(); i++)
   {
-    snprintf(menu.menu_title, sizeof(menu.menu_title), "%s", "Press F Ultra - ROMs");
-    if (joypad_get_accessory_type(JOYPAD_PORT_1) == JOYPAD_ACCESSORY_TYPE_CONTROLLER_PAK)
-      snprintf(menu.menu_subtitle, sizeof(menu.menu_subtitle), "%s", "Press A to load, or Z to copy to Controller Pak.");
-    else
-      snprintf(menu.menu_subtitle, sizeof(menu.menu_subtitle), "%s", "Select a ROM. Press A to load.");
-    emu.menu_roms = menu;
+    const char *name = pfu_romfs_name(i);
+
+    if (strncmp(name, "sl31253.bin", 8) && strncmp(name, "sl31254.bin", 8))
+      pfu_romlist_add(name, PFU_SOURCE_ROMFS);
   }
-  else
-    pfu_error_switch(
-      "Press F Ultra requires Channel F BIOS data to be stored on\n"
-      "the SD Card in the \"press-f\" directory.\n\n"
-      "Please include both the $03sl31253.bin$01 and "
-      "$03sl31254.bin$01 BIOS images.\n\n"
-      "Alternatively, this data can be compiled in statically.\n\n"
-      "See https://github.com/celerizer/Press-F-Ultra for details.");
+  pfu_menus.roms = menu;
+
+  /**
+   * BIOS are looked up by name in the first slice of the SD Card walk rather
+   * than waiting for the walk to reach them. Both continue from
+   * pfu_menu_run, so the menu is shown before either touches the SD Card.
+   */
+  pfu_scan.active = true;
+  pfu_scan.bios_lookup = true;
+  pfu_scan.pending = !dir_findfirst(PFU_PATH_SD_CARD, &pfu_scan.dir);
+  pfu_menu_roms_view();
 }
 
 static uint8_t sine_color;
 
+static const rdpq_textparms_t pfu_shadow_params = {
+  .style_id = PFU_FONT_STYLE_SHADOW };
+
 #define PFU_DROP 3
 #define PFU_ROWS 12
 
+/**
+ * Handles the ROM menu's search and jump-to-letter buttons. Start toggles
+ * search. While searching, C-up and C-down pick a character, C-right adds it
+ * to the search, C-left removes the last one, and B clears the search.
+ * Otherwise, C-left and C-right jump to the previous or next letter.
+ * Returns true if the buttons were handled.
+ */
+static bool pfu_menu_roms_input(joypad_buttons_t buttons)
+{
+  pfu_menu_ctx_t *menu = &pfu_menus.roms;
+  const char *candidate = strchr(pfu_search_characters, pfu_view.candidate);
+  unsigned index = candidate ? candidate - pfu_search_characters : 0;
+  const unsigned characters = sizeof(pfu_search_characters) - 1;
+
+  if (buttons.start)
+    pfu_view.searching = !pfu_view.searching;
+  else if (pfu_view.searching && buttons.c_up)
+    pfu_view.candidate = pfu_search_characters[(index + characters - 1) % characters];
+  else if (pfu_view.searching && buttons.c_down)
+    pfu_view.candidate = pfu_search_characters[(index + 1) % characters];
+  else if (pfu_view.searching && buttons.c_right)
+  {
+    if (pfu_view.length < sizeof(pfu_view.prefix) - 1)
+    {
+      pfu_view.prefix[pfu_view.length++] = pfu_view.candidate;
+      pfu_view.prefix[pfu_view.length] = '\0';
+      menu->cursor = 1;
+    }
+  }
+  else if (pfu_view.searching && buttons.c_left)
+  {
+    if (pfu_view.length)
+      pfu_view.prefix[--pfu_view.length] = '\0';
+  }
+  else if (pfu_view.searching && buttons.b)
+  {
+    pfu_view.searching = false;
+    pfu_view.length = 0;
+    pfu_view.prefix[0] = '\0';
+  }
+  else if ((buttons.c_left || buttons.c_right) && pfu_view.last > pfu_view.first)
+  {
+    unsigned position = menu->cursor > 0 ?
+      pfu_view.first + menu->cursor - 1 : pfu_view.first;
+
+    if (menu->cursor > 0 || buttons.c_left)
+      position = pfu_romlist_letter(position, buttons.c_right ? 1 : -1);
+    if (position < pfu_view.first)
+      position = pfu_view.first;
+    else if (position >= pfu_view.last)
+      position = pfu_view.last - 1;
+    menu->cursor = 1 + position - pfu_view.first;
+  }
+  else
+    return false;
+  pfu_menu_roms_view();
+
+  return true;
+}
+
 static void pfu_menu_input(void)
 {
   joypad_buttons_t buttons;
-  pfu_menu_ctx_t *menu = emu.current_menu;
+  pfu_menu_ctx_t *menu = pfu_menus.current;
   pfu_menu_entry_t *entry;
   
   if (!menu)
     return;
 
-  entry = &emu.current_menu->entries[emu.current_menu->cursor];
+  entry = pfu_menu_row(menu, menu->cursor);
 
   joypad_poll();
   buttons = joypad_get_buttons_pressed(JOYPAD_PORT_1);
-  if (buttons.d_up)
+  if (menu == &pfu_menus.roms && pfu_menu_roms_input(buttons))
+    return;
+  else if (buttons.d_up)
     menu->cursor--;
   else if (buttons.d_down)
     menu->cursor++;
@@ -538,10 +1042,10 @@ static void pfu_menu_input(void)
     switch (entry->type)
     {
     case PFU_ENTRY_TYPE_BOOL:
-      pfu_menu_entry_bool(entry, false);
+      pfu_menu_change(entry, false);
       break;
     case PFU_ENTRY_TYPE_CHOICE:
-      pfu_menu_entry_choice(entry, entry->current_value - 1);
+      pfu_menu_change(entry, entry->current_value - 1);
       break;
     case PFU_ENTRY_TYPE_FILE:
       menu->cursor -= PFU_ROWS;
@@ -552,10 +1056,10 @@ static void pfu_menu_input(void)
     switch (entry->type)
     {
     case PFU_ENTRY_TYPE_BOOL:
-      pfu_menu_entry_bool(entry, true);
+      pfu_menu_change(entry, true);
       break;
     case PFU_ENTRY_TYPE_CHOICE:
-      pfu_menu_entry_choice(entry, entry->current_value + 1);
+      pfu_menu_change(entry, entry->current_value + 1);
       break;
     default:
       menu->cursor += PFU_ROWS;
@@ -565,23 +1069,34 @@ static void pfu_menu_input(void)
     switch (entry->type)
     {
     case PFU_ENTRY_TYPE_BACK:
-      pfu_menu_entry_back();
+      if (entry->key == PFU_ENTRY_KEY_SUSPEND)
+      {
+        pfu_suspend_request();
+        pfu_emu_switch();
+      }
+      else if (pfu_menu_bios_ready())
+        pfu_menu_entry_back();
       break;
     case PFU_ENTRY_TYPE_BOOL:
-      pfu_menu_entry_bool(entry, !entry->current_value);
+      pfu_menu_change(entry, !entry->current_value);
       break;
     case PFU_ENTRY_TYPE_CHOICE:
-      pfu_menu_entry_choice(entry, entry->current_value + 1);
+      pfu_menu_change(entry, entry->current_value + 1);
       break;
     case PFU_ENTRY_TYPE_FILE:
-      pfu_menu_entry_file(entry);
+      if (pfu_menu_bios_ready())
+        pfu_menu_entry_file(entry);
       break;
     default:
       return;
     }
   }
   else if (buttons.b)
+  {
+    /* Returning to the game keeps it, with any settings changed here */
+    pfu_suspend_request();
     pfu_emu_switch();
+  }
   else if (buttons.l)
     pfu_menu_init_roms();
   else if (buttons.z)
@@ -592,46 +1107,141 @@ static void pfu_menu_input(void)
       pfu_controller_pak_write(entry->title, entry->current_value);
     pfu_menu_init_roms();
   }
-  
+
   if (menu->cursor < 0)
     menu->cursor = 0;
   else if (menu->cursor >= menu->entry_count)
     menu->cursor = menu->entry_count - 1;
 }
 
+/**
+ * Checks for a file without opening it. Bundled ROMs are looked up in the
+ * pack manifest, and Controller Pak notes in the cached directory, where
+ * they are named with their extension changed to .CHF.
+ */
+static bool pfu_source_exists(const char *path, unsigned source)
+{
+  struct stat st;
+  char fullpath[1024];
+
+  if (source == PFU_SOURCE_ROMFS)
+    return pfu_romfs_find(path) >= 0;
+  else if (source == PFU_SOURCE_CONTROLLER_PAK)
+  {
+    const char *extension = strrchr(path, '.');
+    size_t length = extension ? (size_t)(extension - path) : strlen(path);
+    unsigned i;
+
+    for (i = 0; i < pfu_cpak_rom_count(); i++)
+    {
+      const char *name = pfu_cpak_rom_name(i);
+
+      if (!strncmp(name, path, length) && !strcmp(&name[length], ".CHF"))
+        return true;
+    }
+
+    return false;
+  }
+  pfu_source_path(fullpath, sizeof(fullpath), path, source);
+
+  return !stat(fullpath, &st);
+}
+
+bool pfu_menu_load_bios(void)
+{
+  static const unsigned sources[] = {
+    PFU_SOURCE_ROMFS, PFU_SOURCE_SD_CARD, PFU_SOURCE_CONTROLLER_PAK
+  };
+  unsigned i;
+
+  for (i = 0; i < sizeof(sources) / sizeof(sources[0]); i++)
+  {
+    if (!frontend.bios_a_loaded && pfu_source_exists("sl31253.bin", sources[i]))
+      frontend.bios_a_loaded = pfu_load_rom(0x0000, "sl31253.bin", sources[i], NULL);
+    if (!frontend.bios_b_loaded && pfu_source_exists("sl31254.bin", sources[i]))
+      frontend.bios_b_loaded = pfu_load_rom(0x0400, "sl31254.bin", sources[i], NULL);
+  }
+
+  return frontend.bios_a_loaded && frontend.bios_b_loaded;
+}
+
+bool pfu_menu_find_bios(void)
+{
+  if (!pfu_menus.roms.entries)
+    pfu_menu_init_roms();
+
+  return pfu_menu_bios_ready();
+}
+
+bool pfu_menu_autoload(void)
+{
+  pfu_menu_entry_t entry;
+  unsigned source;
+  const char *name = pfu_config_rom(&source);
+
+  if (!name || source >= PFU_SOURCE_SIZE)
+    return false;
+  else if (source == PFU_SOURCE_CONTROLLER_PAK ?
+           !pfu_cpak_mount() : !pfu_source_exists(name, source))
+    return false;
+  else if (!pfu_menu_load_bios())
+    return false;
+
+  memset(&entry, 0, sizeof(entry));
+  snprintf(entry.title, sizeof(entry.title), "%s", name);
+  entry.type = PFU_ENTRY_TYPE_FILE;
+  entry.current_value = source;
+  pfu_menu_entry_file(&entry);
+
+  return true;
+}
+
+/**
+ * Initializes the settings menu with the stored settings. The ROM menu is
+ * scanned the first time it is opened.
+ */
 void pfu_menu_init(void)
 {
-  memset(&emu.menu_roms, 0, sizeof(emu.menu_roms));
-  memset(&emu.menu_settings, 0, sizeof(emu.menu_settings));
-  pfu_menu_init_roms();
+  int i;
+
+  memset(&pfu_menus.roms, 0, sizeof(pfu_menus.roms));
+  memset(&pfu_menus.settings, 0, sizeof(pfu_menus.settings));
   pfu_menu_init_settings();
+
+  /* Every setting starts at 0, so only others need applying */
+  for (i = 0; i < pfu_menus.settings.entry_count; i++)
+  {
+    pfu_entry_key key = pfu_menus.settings.entries[i].key;
+
+    if (pfu_menu_key_persists(key) && pfu_config_setting(key))
+      pfu_menu_set_setting(key, pfu_config_setting(key));
+  }
 }
 
 void pfu_menu_run(void)
 {
-  surface_t *disp = display_get();
-  const pfu_menu_ctx_t *menu = emu.current_menu;
+  surface_t *disp;
+  pfu_menu_ctx_t *menu = pfu_menus.current;
   int i;
 
   if (!menu)
     return;
+  pfu_assets_init();
 
   /**
    * Every second, check if Controller Pak state has changed.
    * If so, reload the ROM list.
    */
-  if (emu.frames % 60 == 0)
+  if (emu.frames % 60 == 0 && pfu_cpak_poll())
   {
-    bool pak = joypad_get_accessory_type(JOYPAD_PORT_1) ==
-                 JOYPAD_ACCESSORY_TYPE_CONTROLLER_PAK;
-
-    if (pak != pfu_pak_connected)
-    {
-      pfu_pak_connected = pak;
-      pfu_menu_init_roms();
-    }
+    pfu_romcache_drop_source(PFU_SOURCE_CONTROLLER_PAK);
+    pfu_menu_init_roms();
   }
+  pfu_menu_scan_step(PFU_SCAN_SLICE_US);
+  if (menu == &pfu_menus.roms)
+    pfu_menu_roms_view();
 
+  disp = display_get();
   rdpq_attach_clear(disp, NULL);
   rdpq_set_mode_fill(RGBA32(0x22, 0x22, 0x22, 1));
   rdpq_fill_rectangle(0, 0, display_get_width(), display_get_height());
@@ -641,18 +1251,19 @@ void pfu_menu_run(void)
 
   rdpq_set_mode_copy(false);
 
-  rdpq_sprite_blit(emu.icon, 48, 32, NULL);
+  rdpq_sprite_blit(frontend.icon, 48, 32, NULL);
 
-  rdpq_text_printf(NULL, 1, 64 + 48 + 8, 32 + 24, menu->menu_title);
-  rdpq_text_printf(NULL, 1, 64 + 48 + 8, 32 + 24 * 2, menu->menu_subtitle);
+  rdpq_text_printf(NULL, PFU_FONT_MAIN, 64 + 48 + 8, 32 + 24, menu->menu_title);
+  rdpq_text_printf(NULL, PFU_FONT_MAIN, 64 + 48 + 8, 32 + 24 * 2, menu->menu_subtitle);
   for (i = (menu->cursor / PFU_ROWS) * PFU_ROWS; i < (menu->cursor / PFU_ROWS) * PFU_ROWS + PFU_ROWS && i < menu->entry_count; i++)
   {
-    char print_string[sizeof(menu->entries[0].title)];
+    const pfu_menu_entry_t *entry = pfu_menu_row(menu, i);
+    char print_string[sizeof(entry->title)];
     int j = i % PFU_ROWS;
     int k;
 
     /* Prevent characters in files from being read as text control codes */
-    snprintf(print_string, sizeof(print_string), "%s", menu->entries[i].title);
+    snprintf(print_string, sizeof(print_string), "%s", entry->title);
     for (k = 0; print_string[k] != '\0'; k++)
     {
       if (print_string[k] == '$' || print_string[k] == '^')
@@ -662,27 +1273,37 @@ void pfu_menu_run(void)
     }
 
     if (i == menu->cursor)
-      rdpq_text_printf(NULL, 2, 48 + 8 + PFU_DROP, 32 + 64 + 24 + j * 24 + PFU_DROP, print_string);
-    rdpq_text_printf(NULL, 1, 48 + 8, 32 + 64 + 24 + j * 24, print_string);
-    if (menu->entries[i].type == PFU_ENTRY_TYPE_BOOL)
-      rdpq_text_printf(NULL, 1, 386, 32 + 64 + 24 + j * 24, menu->entries[i].current_value ? "Enabled" : "Disabled");
-    else if (menu->entries[i].type == PFU_ENTRY_TYPE_CHOICE)
-      rdpq_text_printf(NULL, 1, 386, 32 + 64 + 24 + j * 24, menu->entries[i].choices[menu->entries[i].current_value]);
+      rdpq_text_printf(&pfu_shadow_params, PFU_FONT_MAIN, 48 + 8 + PFU_DROP, 32 + 64 + 24 + j * 24 + PFU_DROP, print_string);
+    rdpq_text_printf(NULL, PFU_FONT_MAIN, 48 + 8, 32 + 64 + 24 + j * 24, print_string);
+    if (entry->type == PFU_ENTRY_TYPE_BOOL)
+      rdpq_text_printf(NULL, PFU_FONT_MAIN, 386, 32 + 64 + 24 + j * 24, entry->current_value ? "Enabled" : "Disabled");
+    else if (entry->type == PFU_ENTRY_TYPE_CHOICE)
+      rdpq_text_printf(NULL, PFU_FONT_MAIN, 386, 32 + 64 + 24 + j * 24, entry->choices[entry->current_value]);
   }
+  pfu_overlay_draw();
   rdpq_detach_show();
 
+  /* The ROM menu is interactive from the first frame it is shown */
+  if (menu == &pfu_menus.roms && !pfu_scan.interactive_ticks)
+  {
+    pfu_scan.interactive_ticks = get_ticks() - pfu_scan.start;
+    pfu_menu_scan_log();
+  }
+
   sine_color = (int)(sin(emu.frames * 0.1) * 127.0) + 128;
   pfu_menu_input();
 }
 
 void pfu_menu_switch_roms(void)
 {
+  if (!pfu_menus.roms.entries)
+    pfu_menu_init_roms();
   emu.state = PFU_STATE_MENU;
-  emu.current_menu = &emu.menu_roms;
+  pfu_menus.current = &pfu_menus.roms;
 }
 
 void pfu_menu_switch_settings(void)
 {
   emu.state = PFU_STATE_MENU;
-  emu.current_menu = &emu.menu_settings;
+  pfu_menus.current = &pfu_menus.settings;
 }
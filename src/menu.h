@@ -1,7 +1,6 @@
 #ifndef PRESS_F_ULTRA_MENU_H
 #define PRESS_F_ULTRA_MENU_H
 
-#define PFU_MENU_MAX_ENTRIES 256
 #define PFU_MENU_MAX_CHOICES 8
 
 typedef enum
@@ -12,6 +11,14 @@ typedef enum
   PFU_ENTRY_KEY_PIXEL_PERFECT,
   PFU_ENTRY_KEY_SYSTEM_MODEL,
   PFU_ENTRY_KEY_FONT,
+  PFU_ENTRY_KEY_FRAME_DUMP,
+  PFU_ENTRY_KEY_DEBUG_OVERLAY,
+  PFU_ENTRY_KEY_AUDIO_RATE,
+  PFU_ENTRY_KEY_AUDIO_SYNTH,
+  PFU_ENTRY_KEY_SUSPEND,
+  PFU_ENTRY_KEY_OVERCLOCK,
+  PFU_ENTRY_KEY_AUTOLOAD,
+  PFU_ENTRY_KEY_BOOTCACHE_SD,
 
   PFU_ENTRY_KEY_SIZE
 } pfu_entry_key;
@@ -51,6 +58,44 @@ void pfu_menu_run(void);
 
 void pfu_menu_init(void);
 
+/**
+ * Loads the BIOS images from their standard names without scanning for
+ * ROMs, looking in the bundled ROMs, then the SD Card, then the Controller
+ * Pak. Returns true if both BIOS images are loaded.
+ */
+bool pfu_menu_load_bios(void);
+
+/**
+ * Finishes scanning for ROMs to find BIOS images not found by name. Returns
+ * true if both BIOS images are loaded; otherwise the missing BIOS error has
+ * been shown.
+ */
+bool pfu_menu_find_bios(void);
+
+/**
+ * Returns the current value of a setting, or 0 if it is not in the settings
+ * menu.
+ */
+signed pfu_menu_get_setting(pfu_entry_key key);
+
+/**
+ * Changes a setting as if it were selected in the settings menu, so the menu
+ * reflects the new value.
+ */
+void pfu_menu_set_setting(pfu_entry_key key, signed value);
+
+/**
+ * Returns whether a setting is kept across boots and suspended sessions.
+ * Debugging aids always start off.
+ */
+bool pfu_menu_key_persists(pfu_entry_key key);
+
+/**
+ * Loads the BIOS and the last loaded ROM, without scanning for ROMs, and
+ * starts emulation. Returns false if no ROM was recorded or it is gone.
+ */
+bool pfu_menu_autoload(void);
+
 void pfu_menu_switch_roms(void);
 
 void pfu_menu_switch_settings(void);
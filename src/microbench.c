@@ -0,0 +1,133 @@
+#if PFU_MICROBENCH
+#include <libdragon.h>
+#endif
+#include <string.h>
+
+#include "microbench.h"
+
+/* pressf_run emulates one video frame of the guest clock */
+#define PFU_MICROBENCH_FRAME_RATE 60
+
+/* Largest loop body, so the closing branch can reach its start */
+#define PFU_MICROBENCH_MAX_BODY 120
+
+/* BR back to the start of the loop, and its length in clock periods */
+#define PFU_MICROBENCH_BR 0x90
+#define PFU_MICROBENCH_BR_CYCLES 14
+
+/**
+ * A sequence of instructions repeated to fill a loop. Cycles are the
+ * sequence's length in clock periods, from the F3850 data sheet.
+ */
+typedef struct
+{
+  const char *name;
+  const u8 *code;
+  unsigned size;
+  unsigned instructions;
+  unsigned cycles;
+} pfu_microbench_t;
+
+/* LR A,0; AS 1; LI $05; DS 2 */
+static const u8 pfu_microbench_alu[] = { 0x40, 0xC1, 0x20, 0x05, 0x32 };
+
+/* LISU 2; LISL 0; LR (IS),A; LR A,(IS); LR A,IS; LR IS,A */
+static const u8 pfu_microbench_scratchpad[] = { 0x62, 0x68, 0x5C, 0x4C, 0x0A, 0x0B };
+
+/* DCI $0800; LM; ST */
+static const u8 pfu_microbench_memory[] = { 0x2A, 0x08, 0x00, 0x16, 0x17 };
+
+/* BR to the next instruction */
+static const u8 pfu_microbench_branch[] = { 0x90, 0x01 };
+
+/* INS 0; OUTS 1 */
+static const u8 pfu_microbench_io[] = { 0xA0, 0xB1 };
+
+static const pfu_microbench_t pfu_microbenches[] = {
+  { "alu", pfu_microbench_alu, sizeof(pfu_microbench_alu), 4, 24 },
+  { "scratch", pfu_microbench_scratchpad, sizeof(pfu_microbench_scratchpad), 6, 24 },
+  { "memory", pfu_microbench_memory, sizeof(pfu_microbench_memory), 3, 44 },
+  { "branch", pfu_microbench_branch, sizeof(pfu_microbench_branch), 1, 14 },
+  { "io", pfu_microbench_io, sizeof(pfu_microbench_io), 2, 16 }
+};
+
+unsigned pfu_microbench_count(void)
+{
+  return sizeof(pfu_microbenches) / sizeof(pfu_microbenches[0]);
+}
+
+static unsigned pfu_microbench_repeat(const pfu_microbench_t *bench)
+{
+  return PFU_MICROBENCH_MAX_BODY / bench->size;
+}
+
+void pfu_microbench_load(f8_system_t *system, unsigned index)
+{
+  const pfu_microbench_t *bench = &pfu_microbenches[index];
+  u8 program[PFU_MICROBENCH_MAX_BODY + 2];
+  unsigned size = 0, i;
+
+  for (i = 0; i < pfu_microbench_repeat(bench); i++)
+  {
+    memcpy(&program[size], bench->code, bench->size);
+    size += bench->size;
+  }
+
+  /* The branch offset is relative to its own operand */
+  program[size++] = PFU_MICROBENCH_BR;
+  program[size] = (u8)(0x100 - size);
+  size++;
+
+  f8_write(system, 0x0000, program, size);
+  pressf_reset(system);
+}
+
+void pfu_microbench_header(FILE *file)
+{
+  fprintf(file, "# class frames instructions ns_per_instruction "
+                "host_cycles_per_guest_cycle\n");
+}
+
+void pfu_microbench_print(FILE *file, const f8_system_t *system,
+                          unsigned index, unsigned frames, double seconds,
+                          double host_cycles)
+{
+  const pfu_microbench_t *bench = &pfu_microbenches[index];
+  const unsigned repeat = pfu_microbench_repeat(bench);
+  double guest_cycles = (double)system->settings.f3850_clock_speed * frames /
+                        PFU_MICROBENCH_FRAME_RATE;
+  double instructions = guest_cycles * (repeat * bench->instructions + 1) /
+                        (repeat * bench->cycles + PFU_MICROBENCH_BR_CYCLES);
+
+  fprintf(file, "%s %u %.0f %.2f %.2f\n", bench->name, frames, instructions,
+          seconds * 1e9 / instructions, host_cycles / guest_cycles);
+}
+
+#if PFU_MICROBENCH
+
+void pfu_microbench_run(f8_system_t *system)
+{
+  FILE *file = fopen(PFU_PATH_MICROBENCH, "w");
+  unsigned i, frame;
+
+  if (!file)
+    return;
+  pfu_microbench_header(file);
+  for (i = 0; i < pfu_microbench_count(); i++)
+  {
+    u32 start, ticks;
+
+    pfu_microbench_load(system, i);
+    start = get_ticks();
+    for (frame = 0; frame < PFU_MICROBENCH_FRAMES; frame++)
+      pressf_run(system);
+    ticks = get_ticks() - start;
+
+    /* The count register advances every other CPU cycle */
+    pfu_microbench_print(file, system, i, PFU_MICROBENCH_FRAMES,
+                         (double)ticks / TICKS_PER_SECOND, ticks * 2.0);
+  }
+  fclose(file);
+}
+
+#endif
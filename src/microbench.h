@@ -0,0 +1,58 @@
+#ifndef PRESS_F_ULTRA_MICROBENCH_H
+#define PRESS_F_ULTRA_MICROBENCH_H
+
+#include <stdio.h>
+
+#include "libpressf/src/emu.h"
+
+/**
+ * Synthetic F8 programs timing one class of instructions each, run by the
+ * host tool tools/pfmicro and, when built with MICROBENCH=1, on the N64.
+ * Both write the same format, one line per class:
+ *
+ *   <class> <frames> <instructions> <ns_per_instruction> <host_cycles_per_guest_cycle>
+ */
+#ifndef PFU_MICROBENCH
+#define PFU_MICROBENCH 0
+#endif
+
+#define PFU_PATH_MICROBENCH "sd:/press-f/microbench.txt"
+
+/* Frames each class is run for on the N64 */
+#define PFU_MICROBENCH_FRAMES 600
+
+/**
+ * Returns the number of instruction classes.
+ */
+unsigned pfu_microbench_count(void);
+
+/**
+ * Writes the program for an instruction class at $0000 through the system
+ * bus, then resets the system so it starts running it.
+ */
+void pfu_microbench_load(f8_system_t *system, unsigned index);
+
+/**
+ * Writes the column header of the results.
+ */
+void pfu_microbench_header(FILE *file);
+
+/**
+ * Writes the results of running an instruction class for a number of
+ * frames, which took the given time and host CPU cycles.
+ */
+void pfu_microbench_print(FILE *file, const f8_system_t *system,
+                          unsigned index, unsigned frames, double seconds,
+                          double host_cycles);
+
+#if PFU_MICROBENCH
+
+/**
+ * Runs every instruction class on the N64 and writes the results to
+ * PFU_PATH_MICROBENCH.
+ */
+void pfu_microbench_run(f8_system_t *system);
+
+#endif
+
+#endif
@@ -0,0 +1,87 @@
+#include <libdragon.h>
+
+#include "audio.h"
+#include "main.h"
+#include "memory.h"
+#include "romcache.h"
+#include "overlay.h"
+#include "stats.h"
+
+#define PFU_OVERLAY_X 8
+#define PFU_OVERLAY_Y 12
+#define PFU_OVERLAY_LINE_HEIGHT 10
+
+static bool pfu_overlay_enabled = false;
+
+/**
+ * Heap and stack use are costly to measure, as they walk the allocator's
+ * lists and the painted stack, so they are refreshed once a second.
+ */
+typedef struct
+{
+  bool valid;
+  u32 updated;
+  unsigned heap_used;
+  unsigned stack_used;
+} pfu_overlay_memory_t;
+
+static pfu_overlay_memory_t pfu_overlay_memory;
+
+void pfu_overlay_set_enabled(bool enabled)
+{
+  if (enabled)
+  {
+    pfu_assets_init();
+    pfu_memory_report();
+    pfu_overlay_memory.valid = false;
+  }
+  pfu_overlay_enabled = enabled;
+}
+
+void pfu_overlay_draw(void)
+{
+  const pfu_memory_usage_t *total;
+  const pfu_audio_stats_t *audio;
+  const pfu_romcache_stats_t *cache;
+  int y = PFU_OVERLAY_Y;
+
+  if (!pfu_overlay_enabled)
+    return;
+  total = pfu_memory_usage(PFU_MEMORY_TAG_SIZE);
+  audio = pfu_audio_stats();
+  cache = pfu_romcache_stats();
+  if (!pfu_overlay_memory.valid ||
+      get_ticks() - pfu_overlay_memory.updated >= TICKS_PER_SECOND)
+  {
+    pfu_overlay_memory.heap_used = pfu_memory_heap_used();
+    pfu_overlay_memory.stack_used = pfu_memory_stack_high_water();
+    pfu_overlay_memory.updated = get_ticks();
+    pfu_overlay_memory.valid = true;
+  }
+
+  rdpq_text_printf(NULL, PFU_FONT_DEBUG, PFU_OVERLAY_X, y,
+    "Frame %lu us  Emu %lu us  Wait %u%%  Dropped %u",
+    (unsigned long)TICKS_TO_US(pfu_stats.frame_ticks),
+    (unsigned long)TICKS_TO_US(pfu_stats.emulation_ticks),
+    pfu_stats.wait_percent, pfu_stats.dropped_frames);
+  y += PFU_OVERLAY_LINE_HEIGHT;
+  rdpq_text_printf(NULL, PFU_FONT_DEBUG, PFU_OVERLAY_X, y,
+    "Heap %u KB  Tracked %u KB  Peak %u KB",
+    pfu_overlay_memory.heap_used / 1024, total->current / 1024,
+    total->peak / 1024);
+  y += PFU_OVERLAY_LINE_HEIGHT;
+  rdpq_text_printf(NULL, PFU_FONT_DEBUG, PFU_OVERLAY_X, y,
+    "Stack %u B  RAM %u MB%s", pfu_overlay_memory.stack_used,
+    get_memory_size() / (1024 * 1024),
+    is_memory_expanded() ? " (Expansion Pak)" : "");
+  y += PFU_OVERLAY_LINE_HEIGHT;
+  rdpq_text_printf(NULL, PFU_FONT_DEBUG, PFU_OVERLAY_X, y,
+    "Audio %u Hz  Resample %u us  Push %u us  Edges %u", audio->frequency,
+    audio->resample_us, audio->push_us, audio->events);
+  y += PFU_OVERLAY_LINE_HEIGHT;
+  rdpq_text_printf(NULL, PFU_FONT_DEBUG, PFU_OVERLAY_X, y,
+    "Cache %u/%u KB  ROMs %u  ROM hits %u/%u  State hits %u/%u",
+    cache->used / 1024, cache->capacity / 1024, cache->entries,
+    cache->rom_hits, cache->rom_hits + cache->rom_misses,
+    cache->state_hits, cache->state_hits + cache->state_misses);
+}
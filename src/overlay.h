@@ -0,0 +1,14 @@
+#ifndef PRESS_F_ULTRA_OVERLAY_H
+#define PRESS_F_ULTRA_OVERLAY_H
+
+#include "libpressf/src/emu.h"
+
+void pfu_overlay_set_enabled(bool enabled);
+
+/**
+ * Draws the debug overlay, if enabled, onto the frame currently attached to
+ * rdpq. Called just before the frame is shown.
+ */
+void pfu_overlay_draw(void);
+
+#endif
@@ -0,0 +1,236 @@
+#include "profile.h"
+
+#if PFU_PROFILE
+
+#include <libdragon.h>
+
+#include "libpressf/src/emu.h"
+#include "libpressf/src/hw/beeper.h"
+#include "libpressf/src/hw/vram.h"
+
+#include "main.h"
+
+/* Addresses and ports listed in the report, most used first */
+#define PFU_PROFILE_TOP_PCS 32
+#define PFU_PROFILE_PORTS 0x100
+
+/* Totals are 64-bit, as 32 bits of microseconds wrap after 71 minutes */
+typedef struct
+{
+  u32 start;
+  u64 total_us;
+  u32 max_us;
+} pfu_profile_timer_t;
+
+typedef struct
+{
+  pfu_profile_timer_t timers[PFU_PROFILE_SIZE];
+  unsigned frames;
+
+  /* Guest output, measured by comparing device state between frames */
+  u8 last_vram[sizeof(((vram_t*)0)->data)];
+  u32 vram_bytes_changed;
+  unsigned vram_frames_changed;
+  u32 beeper_transitions;
+  unsigned beeper_frames_active;
+
+  /* Guest execution, counted by hooks in the core */
+  u32 pc_counts[0x10000];
+  u32 port_reads[PFU_PROFILE_PORTS];
+  u32 port_writes[PFU_PROFILE_PORTS];
+} pfu_profile_t;
+
+static pfu_profile_t profile;
+
+static const char *pfu_profile_phase_names[PFU_PROFILE_SIZE] = {
+  "Input",
+  "Emulation (pressf_run)",
+  "Video conversion",
+  "Audio push",
+  "Render and vsync"
+};
+
+void pfu_profile_begin(pfu_profile_phase phase)
+{
+  profile.timers[phase].start = get_ticks();
+}
+
+void pfu_profile_end(pfu_profile_phase phase)
+{
+  pfu_profile_timer_t *timer = &profile.timers[phase];
+  u32 us = TICKS_TO_US(get_ticks() - timer->start);
+
+  timer->total_us += us;
+  if (us > timer->max_us)
+    timer->max_us = us;
+}
+
+void pfu_profile_guest(void)
+{
+  const vram_t *vram = (const vram_t*)emu.system.f8devices[3].device;
+  const short *samples =
+    (const short*)((f8_beeper_t*)emu.system.f8devices[7].device)->samples;
+  unsigned changed = 0, transitions = 0, i;
+
+  for (i = 0; i < sizeof(profile.last_vram); i++)
+    if (vram->data[i] != profile.last_vram[i])
+      changed++;
+  memcpy(profile.last_vram, vram->data, sizeof(profile.last_vram));
+  profile.vram_bytes_changed += changed;
+  if (changed)
+    profile.vram_frames_changed++;
+
+  for (i = 1; i < PF_SOUND_SAMPLES; i++)
+    if (samples[i] != samples[i - 1])
+      transitions++;
+  profile.beeper_transitions += transitions;
+  if (transitions)
+    profile.beeper_frames_active++;
+
+  profile.frames++;
+}
+
+void pfu_profile_execute(unsigned pc)
+{
+  profile.pc_counts[pc & 0xFFFF]++;
+}
+
+void pfu_profile_port(unsigned port, int write)
+{
+  if (write)
+    profile.port_writes[port & 0xFF]++;
+  else
+    profile.port_reads[port & 0xFF]++;
+}
+
+static void pfu_profile_print_pcs(FILE *file)
+{
+  unsigned top[PFU_PROFILE_TOP_PCS];
+  unsigned used = 0, pc, i;
+  u64 total = 0;
+
+  /* Keep the busiest addresses in order as the histogram is walked */
+  for (pc = 0; pc < 0x10000; pc++)
+  {
+    u32 count = profile.pc_counts[pc];
+
+    total += count;
+    if (!count || (used == PFU_PROFILE_TOP_PCS &&
+                   count <= profile.pc_counts[top[used - 1]]))
+      continue;
+    if (used < PFU_PROFILE_TOP_PCS)
+      used++;
+    for (i = used - 1; i > 0 && profile.pc_counts[top[i - 1]] < count; i--)
+      top[i] = top[i - 1];
+    top[i] = pc;
+  }
+
+  fprintf(file, "\nGuest execution\n");
+  if (!total)
+  {
+    fprintf(file, "No instructions counted; the core has no execute hook\n");
+    return;
+  }
+  fprintf(file, "Instructions: %lu\n", (unsigned long)total);
+  fprintf(file, "Rank PC      Count       Share\n");
+  for (i = 0; i < used; i++)
+    fprintf(file, "%4u %04X %11lu %6lu.%lu%%\n", i + 1, top[i],
+            (unsigned long)profile.pc_counts[top[i]],
+            (unsigned long)(profile.pc_counts[top[i]] * (u64)100 / total),
+            (unsigned long)(profile.pc_counts[top[i]] * (u64)1000 / total % 10));
+}
+
+static void pfu_profile_print_ports(FILE *file)
+{
+  unsigned ranks[PFU_PROFILE_PORTS];
+  unsigned used = 0, port, i;
+
+  /* Rank ports by total accesses, leaving out those never touched */
+  for (port = 0; port < PFU_PROFILE_PORTS; port++)
+  {
+    u32 count = profile.port_reads[port] + profile.port_writes[port];
+
+    if (!count)
+      continue;
+    for (i = used++; i > 0 && profile.port_reads[ranks[i - 1]] +
+         profile.port_writes[ranks[i - 1]] < count; i--)
+      ranks[i] = ranks[i - 1];
+    ranks[i] = port;
+  }
+
+  fprintf(file, "\nGuest I/O\n");
+  if (!used)
+  {
+    fprintf(file, "No port accesses counted; the core has no port hook\n");
+    return;
+  }
+  fprintf(file, "Rank Port      Reads      Writes\n");
+  for (i = 0; i < used; i++)
+    fprintf(file, "%4u  %02X  %10lu  %10lu\n", i + 1, ranks[i],
+            (unsigned long)profile.port_reads[ranks[i]],
+            (unsigned long)profile.port_writes[ranks[i]]);
+}
+
+static void pfu_profile_print(FILE *file)
+{
+  unsigned ranks[PFU_PROFILE_SIZE];
+  u64 total_us = 0;
+  unsigned frames = profile.frames ? profile.frames : 1;
+  unsigned i, j;
+
+  /* Rank phases by total cost */
+  for (i = 0; i < PFU_PROFILE_SIZE; i++)
+  {
+    for (j = i; j > 0 &&
+         profile.timers[ranks[j - 1]].total_us < profile.timers[i].total_us; j--)
+      ranks[j] = ranks[j - 1];
+    ranks[j] = i;
+    total_us += profile.timers[i].total_us;
+  }
+  if (!total_us)
+    total_us = 1;
+
+  fprintf(file, "Press F Ultra profile\n");
+  fprintf(file, "ROM hash: %08lX\n", (unsigned long)frontend.rom_hash);
+  fprintf(file, "Frames: %u\n\n", profile.frames);
+  fprintf(file, "Rank Phase                   Total ms   Avg us   Max us  Share\n");
+  for (i = 0; i < PFU_PROFILE_SIZE; i++)
+  {
+    const pfu_profile_timer_t *timer = &profile.timers[ranks[i]];
+
+    fprintf(file, "%4u %-22s %9lu %8lu %8lu %5lu%%\n", i + 1,
+            pfu_profile_phase_names[ranks[i]],
+            (unsigned long)(timer->total_us / 1000),
+            (unsigned long)(timer->total_us / frames),
+            (unsigned long)timer->max_us,
+            (unsigned long)(timer->total_us / (total_us / 100 ? total_us / 100 : 1)));
+  }
+
+  fprintf(file, "\nGuest output\n");
+  fprintf(file, "VRAM bytes changed: %lu (%lu per frame, %u frames)\n",
+          (unsigned long)profile.vram_bytes_changed,
+          (unsigned long)(profile.vram_bytes_changed / frames),
+          profile.vram_frames_changed);
+  fprintf(file, "Beeper transitions: %lu (%lu per frame, %u frames)\n",
+          (unsigned long)profile.beeper_transitions,
+          (unsigned long)(profile.beeper_transitions / frames),
+          profile.beeper_frames_active);
+
+  pfu_profile_print_pcs(file);
+  pfu_profile_print_ports(file);
+}
+
+void pfu_profile_dump(void)
+{
+  FILE *file = fopen(PFU_PATH_PROFILE, "w");
+
+  pfu_profile_print(stdout);
+  if (file)
+  {
+    pfu_profile_print(file);
+    fclose(file);
+  }
+  memset(&profile, 0, sizeof(profile));
+}
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef PRESS_F_ULTRA_PROFILE_H
+#define PRESS_F_ULTRA_PROFILE_H
+
+/**
+ * Optional profiling of the emulation loop, enabled by building with
+ * PROFILE=1. When disabled, every hook below compiles to nothing.
+ */
+#ifndef PFU_PROFILE
+#define PFU_PROFILE 0
+#endif
+
+#define PFU_PATH_PROFILE "sd:/press-f/profile.txt"
+
+typedef enum
+{
+  PFU_PROFILE_INPUT = 0,
+  PFU_PROFILE_EMULATION,
+  PFU_PROFILE_VIDEO,
+  PFU_PROFILE_AUDIO,
+  PFU_PROFILE_RENDER,
+
+  PFU_PROFILE_SIZE
+} pfu_profile_phase;
+
+#if PFU_PROFILE
+
+void pfu_profile_begin(pfu_profile_phase phase);
+
+void pfu_profile_end(pfu_profile_phase phase);
+
+/**
+ * Samples guest device activity after pressf_run has produced a frame.
+ */
+void pfu_profile_guest(void);
+
+/**
+ * Counts one instruction executed at a guest address. Called from the
+ * execute path of the libpressf core, which is built with the same flags.
+ */
+void pfu_profile_execute(unsigned pc);
+
+/**
+ * Counts one guest read or write of an I/O port. Called from the port
+ * paths of the libpressf core.
+ */
+void pfu_profile_port(unsigned port, int write);
+
+/**
+ * Writes the collected profile, ranked by cost, to the SD Card and debug
+ * output, then starts a new profile.
+ */
+void pfu_profile_dump(void);
+
+#define PFU_PROFILE_BEGIN(phase) pfu_profile_begin(phase)
+#define PFU_PROFILE_END(phase) pfu_profile_end(phase)
+#define PFU_PROFILE_GUEST() pfu_profile_guest()
+#define PFU_PROFILE_EXECUTE(pc) pfu_profile_execute(pc)
+#define PFU_PROFILE_PORT(port, write) pfu_profile_port(port, write)
+#define PFU_PROFILE_DUMP() pfu_profile_dump()
+
+#else
+
+#define PFU_PROFILE_BEGIN(phase)
+#define PFU_PROFILE_END(phase)
+#define PFU_PROFILE_GUEST()
+#define PFU_PROFILE_EXECUTE(pc)
+#define PFU_PROFILE_PORT(port, write)
+#define PFU_PROFILE_DUMP()
+
+#endif
+
+#endif
@@ -0,0 +1,225 @@
+#include <libdragon.h>
+#include <string.h>
+
+#include "memory.h"
+#include "romcache.h"
+
+typedef struct
+{
+  char name[64];
+  unsigned source;
+  u32 hash;
+  u8 *data;
+  unsigned size;
+
+  /* Warm state for this ROM, and the key it was taken with */
+  u32 state_key;
+  u8 *state;
+  unsigned state_size;
+
+  unsigned last_used;
+} pfu_romcache_entry_t;
+
+typedef struct
+{
+  pfu_romcache_entry_t entries[PFU_ROMCACHE_ENTRIES];
+  pfu_romcache_stats_t stats;
+  unsigned uses;
+  bool initialized;
+} pfu_romcache_t;
+
+static pfu_romcache_t romcache;
+
+static void pfu_romcache_init(void)
+{
+  if (romcache.initialized)
+    return;
+  romcache.stats.capacity = is_memory_expanded() ? PFU_ROMCACHE_BUDGET : 0;
+  romcache.initialized = true;
+}
+
+static void pfu_romcache_free_state(pfu_romcache_entry_t *entry)
+{
+  if (!entry->state)
+    return;
+  pfu_free(entry->state);
+  romcache.stats.used -= entry->state_size;
+  entry->state = NULL;
+  entry->state_size = 0;
+}
+
+static void pfu_romcache_evict(pfu_romcache_entry_t *entry)
+{
+  pfu_romcache_free_state(entry);
+  pfu_free(entry->data);
+  romcache.stats.used -= entry->size;
+  romcache.stats.entries--;
+  memset(entry, 0, sizeof(*entry));
+}
+
+/**
+ * Evicts least recently used ROMs until size more bytes fit in the budget.
+ * The entry given is kept. Returns false if the size can never fit.
+ */
+static bool pfu_romcache_reserve(unsigned size,
+                                 const pfu_romcache_entry_t *keep)
+{
+  if (size > romcache.stats.capacity)
+    return false;
+  while (romcache.stats.used + size > romcache.stats.capacity)
+  {
+    pfu_romcache_entry_t *oldest = NULL;
+    unsigned i;
+
+    for (i = 0; i < PFU_ROMCACHE_ENTRIES; i++)
+      if (romcache.entries[i].data && &romcache.entries[i] != keep &&
+          (!oldest || romcache.entries[i].last_used < oldest->last_used))
+        oldest = &romcache.entries[i];
+    if (!oldest)
+      return false;
+    pfu_romcache_evict(oldest);
+  }
+
+  return true;
+}
+
+static pfu_romcache_entry_t *pfu_romcache_find(const char *name,
+                                               unsigned source)
+{
+  unsigned i;
+
+  for (i = 0; i < PFU_ROMCACHE_ENTRIES; i++)
+    if (romcache.entries[i].data && romcache.entries[i].source == source &&
+        !strcmp(romcache.entries[i].name, name))
+      return &romcache.entries[i];
+
+  return NULL;
+}
+
+static pfu_romcache_entry_t *pfu_romcache_find_hash(u32 hash)
+{
+  unsigned i;
+
+  for (i = 0; i < PFU_ROMCACHE_ENTRIES; i++)
+    if (romcache.entries[i].data && romcache.entries[i].hash == hash)
+      return &romcache.entries[i];
+
+  return NULL;
+}
+
+unsigned pfu_romcache_load(const char *name, unsigned source, void *dst,
+                           unsigned size, u32 *hash)
+{
+  pfu_romcache_entry_t *entry;
+
+  pfu_romcache_init();
+  if (!romcache.stats.capacity)
+    return 0;
+  entry = pfu_romcache_find(name, source);
+  if (!entry || entry->size > size)
+  {
+    romcache.stats.rom_misses++;
+    return 0;
+  }
+  memcpy(dst, entry->data, entry->size);
+  if (hash)
+    *hash = entry->hash;
+  entry->last_used = ++romcache.uses;
+  romcache.stats.rom_hits++;
+
+  return entry->size;
+}
+
+void pfu_romcache_store(const char *name, unsigned source, const void *data,
+                        unsigned size, u32 hash)
+{
+  pfu_romcache_entry_t *entry = NULL;
+  unsigned i;
+
+  pfu_romcache_init();
+  if (!size || strlen(name) >= sizeof(entry->name))
+    return;
+
+  /* Replace any stale copy, then find a free entry */
+  entry = pfu_romcache_find(name, source);
+  if (entry)
+    pfu_romcache_evict(entry);
+  if (!pfu_romcache_reserve(size, NULL))
+    return;
+  for (i = 0, entry = NULL; i < PFU_ROMCACHE_ENTRIES && !entry; i++)
+    if (!romcache.entries[i].data)
+      entry = &romcache.entries[i];
+  if (!entry)
+  {
+    for (i = 0; i < PFU_ROMCACHE_ENTRIES; i++)
+      if (!entry || romcache.entries[i].last_used < entry->last_used)
+        entry = &romcache.entries[i];
+    pfu_romcache_evict(entry);
+  }
+
+  entry->data = pfu_malloc(PFU_MEMORY_CACHE, size);
+  if (!entry->data)
+    return;
+  memcpy(entry->data, data, size);
+  snprintf(entry->name, sizeof(entry->name), "%s", name);
+  entry->source = source;
+  entry->hash = hash;
+  entry->size = size;
+  entry->last_used = ++romcache.uses;
+  romcache.stats.used += size;
+  romcache.stats.entries++;
+}
+
+void pfu_romcache_drop_source(unsigned source)
+{
+  unsigned i;
+
+  for (i = 0; i < PFU_ROMCACHE_ENTRIES; i++)
+    if (romcache.entries[i].data && romcache.entries[i].source == source)
+      pfu_romcache_evict(&romcache.entries[i]);
+}
+
+const void *pfu_romcache_state(u32 rom_hash, u32 key, unsigned *size)
+{
+  pfu_romcache_entry_t *entry;
+
+  if (!romcache.stats.capacity)
+    return NULL;
+  entry = pfu_romcache_find_hash(rom_hash);
+  if (!entry || !entry->state || entry->state_key != key)
+  {
+    romcache.stats.state_misses++;
+    return NULL;
+  }
+  entry->last_used = ++romcache.uses;
+  romcache.stats.state_hits++;
+  *size = entry->state_size;
+
+  return entry->state;
+}
+
+void pfu_romcache_store_state(u32 rom_hash, u32 key, const void *data,
+                              unsigned size)
+{
+  pfu_romcache_entry_t *entry = pfu_romcache_find_hash(rom_hash);
+
+  if (!entry)
+    return;
+  pfu_romcache_free_state(entry);
+  if (!pfu_romcache_reserve(size, entry))
+    return;
+  entry->state = pfu_malloc(PFU_MEMORY_CACHE, size);
+  if (!entry->state)
+    return;
+  memcpy(entry->state, data, size);
+  entry->state_key = key;
+  entry->state_size = size;
+  romcache.stats.used += size;
+}
+
+const pfu_romcache_stats_t *pfu_romcache_stats(void)
+{
+  pfu_romcache_init();
+
+  return &romcache.stats;
+}
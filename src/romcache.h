@@ -0,0 +1,63 @@
+#ifndef PRESS_F_ULTRA_ROMCACHE_H
+#define PRESS_F_ULTRA_ROMCACHE_H
+
+#include "libpressf/src/emu.h"
+
+/* Most ROMs kept at once */
+#define PFU_ROMCACHE_ENTRIES 32
+
+/**
+ * Memory the cache may use with an Expansion Pak. The rest of the extra
+ * 4 MB is left for the heap. Without an Expansion Pak, nothing is cached.
+ */
+#define PFU_ROMCACHE_BUDGET 0x200000
+
+typedef struct
+{
+  unsigned capacity;
+  unsigned used;
+  unsigned entries;
+
+  unsigned rom_hits;
+  unsigned rom_misses;
+  unsigned state_hits;
+  unsigned state_misses;
+} pfu_romcache_stats_t;
+
+/**
+ * Copies a cached ROM image into dst, which holds size bytes. hash, if not
+ * NULL, receives its CRC32. Returns the size of the ROM, or 0 if it is not
+ * cached.
+ */
+unsigned pfu_romcache_load(const char *name, unsigned source, void *dst,
+                           unsigned size, u32 *hash);
+
+/**
+ * Keeps a copy of a ROM image just loaded from its source, evicting the
+ * least recently used ROMs if needed.
+ */
+void pfu_romcache_store(const char *name, unsigned source, const void *data,
+                        unsigned size, u32 hash);
+
+/**
+ * Forgets every ROM loaded from a source, such as when the Controller Pak
+ * is swapped.
+ */
+void pfu_romcache_drop_source(unsigned source);
+
+/**
+ * Returns the warm state kept with a cached ROM for the given key, or NULL.
+ * size receives its size.
+ */
+const void *pfu_romcache_state(u32 rom_hash, u32 key, unsigned *size);
+
+/**
+ * Keeps a warm state with the cached ROM of the given hash, replacing any
+ * it had. Does nothing if the ROM is not cached.
+ */
+void pfu_romcache_store_state(u32 rom_hash, u32 key, const void *data,
+                              unsigned size);
+
+const pfu_romcache_stats_t *pfu_romcache_stats(void);
+
+#endif
@@ -0,0 +1,152 @@
+#include <libdragon.h>
+
+#include "memory.h"
+#include "romfs.h"
+#include "FastLZ/fastlz.h"
+
+#define PFU_ROMFS_HEADER_SIZE 12
+#define PFU_ROMFS_ENTRY_SIZE 20
+
+static u8 *pfu_romfs_manifest = NULL;
+static const char *pfu_romfs_names = NULL;
+static unsigned pfu_romfs_entries = 0;
+static unsigned pfu_romfs_names_size = 0;
+static bool pfu_romfs_loaded = false;
+
+static u32 pfu_romfs_read_u32(const u8 *src)
+{
+  return ((u32)src[0] << 24) | ((u32)src[1] << 16) |
+         ((u32)src[2] << 8) | (u32)src[3];
+}
+
+/**
+ * Reads the whole manifest with one file read. A missing or malformed pack
+ * is treated as empty, leaving the SD Card and Controller Pak as sources.
+ */
+static void pfu_romfs_load_manifest(void)
+{
+  u8 header[PFU_ROMFS_HEADER_SIZE];
+  FILE *file;
+
+  pfu_romfs_loaded = true;
+  file = fopen(PFU_ROMFS_PATH, "rb");
+  if (!file)
+    return;
+
+  if (fread(header, 1, sizeof(header), file) == sizeof(header) &&
+      pfu_romfs_read_u32(header) == PFU_ROMFS_MAGIC &&
+      ((header[4] << 8) | header[5]) == PFU_ROMFS_VERSION)
+  {
+    unsigned count = (header[6] << 8) | header[7];
+    unsigned size = pfu_romfs_read_u32(&header[8]);
+
+    if (count && size > count * PFU_ROMFS_ENTRY_SIZE)
+    {
+      pfu_romfs_manifest = pfu_malloc(PFU_MEMORY_ASSETS, size);
+      if (pfu_romfs_manifest &&
+          fread(pfu_romfs_manifest, 1, size, file) == size &&
+          pfu_romfs_manifest[size - 1] == '\0')
+      {
+        pfu_romfs_entries = count;
+        pfu_romfs_names =
+          (const char*)&pfu_romfs_manifest[count * PFU_ROMFS_ENTRY_SIZE];
+        pfu_romfs_names_size = size - count * PFU_ROMFS_ENTRY_SIZE;
+      }
+      else
+      {
+        pfu_free(pfu_romfs_manifest);
+        pfu_romfs_manifest = NULL;
+      }
+    }
+  }
+  fclose(file);
+}
+
+unsigned pfu_romfs_count(void)
+{
+  if (!pfu_romfs_loaded)
+    pfu_romfs_load_manifest();
+
+  return pfu_romfs_entries;
+}
+
+const char *pfu_romfs_name(unsigned index)
+{
+  const u8 *entry;
+  unsigned offset;
+
+  if (index >= pfu_romfs_count())
+    return NULL;
+  entry = &pfu_romfs_manifest[index * PFU_ROMFS_ENTRY_SIZE];
+  offset = (entry[16] << 8) | entry[17];
+
+  return offset < pfu_romfs_names_size ? &pfu_romfs_names[offset] : "";
+}
+
+int pfu_romfs_find(const char *name)
+{
+  unsigned low = 0, high = pfu_romfs_count();
+
+  /* Binary search over the entries, which are sorted by name */
+  while (low < high)
+  {
+    unsigned mid = low + (high - low) / 2;
+    int order = strcmp(pfu_romfs_name(mid), name);
+
+    if (!order)
+      return mid;
+    else if (order < 0)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+
+  return -1;
+}
+
+unsigned pfu_romfs_load(unsigned index, void *dst, unsigned size, u32 *hash)
+{
+  const u8 *entry;
+  u32 offset, stored_size, rom_size;
+  unsigned loaded = 0;
+  FILE *file;
+
+  if (index >= pfu_romfs_count())
+    return 0;
+  entry = &pfu_romfs_manifest[index * PFU_ROMFS_ENTRY_SIZE];
+  offset = pfu_romfs_read_u32(&entry[0]);
+  stored_size = pfu_romfs_read_u32(&entry[4]);
+  rom_size = pfu_romfs_read_u32(&entry[8]);
+  if (rom_size > size)
+    return 0;
+
+  file = fopen(PFU_ROMFS_PATH, "rb");
+  if (!file)
+    return 0;
+  if (!fseek(file, offset, SEEK_SET))
+  {
+    if (stored_size == rom_size)
+    {
+      /* Stored uncompressed, so read straight into place */
+      if (fread(dst, 1, rom_size, file) == rom_size)
+        loaded = rom_size;
+    }
+    else
+    {
+      u8 *compressed = pfu_malloc(PFU_MEMORY_LOADER, stored_size);
+
+      if (compressed &&
+          fread(compressed, 1, stored_size, file) == stored_size &&
+          fastlz_decompress(compressed, stored_size, dst, rom_size) ==
+            (int)rom_size)
+        loaded = rom_size;
+      pfu_free(compressed);
+    }
+  }
+  fclose(file);
+
+  if (loaded && hash)
+    *hash = pfu_romfs_read_u32(&entry[12]);
+
+  return loaded;
+}
@@ -0,0 +1,37 @@
+#ifndef PRESS_F_ULTRA_ROMFS_H
+#define PRESS_F_ULTRA_ROMFS_H
+
+#include "libpressf/src/emu.h"
+
+/**
+ * Bundled ROMs, packed at build time by tools/mkromfs. A manifest of names,
+ * sizes, hashes and offsets precedes the ROM data, which is compressed with
+ * FastLZ unless that would not save space.
+ */
+#define PFU_ROMFS_PATH "rom:/roms.pak"
+#define PFU_ROMFS_MAGIC 0x50465250 /* "PFRP" */
+#define PFU_ROMFS_VERSION 1
+
+/**
+ * Returns the number of bundled ROMs, reading the manifest on first use.
+ */
+unsigned pfu_romfs_count(void);
+
+/**
+ * Returns the file name of a bundled ROM. ROMs are sorted by name.
+ */
+const char *pfu_romfs_name(unsigned index);
+
+/**
+ * Returns the index of the bundled ROM with the given name, or -1.
+ */
+int pfu_romfs_find(const char *name);
+
+/**
+ * Decompresses a bundled ROM into dst, which holds size bytes. If hash is
+ * not NULL, it receives the CRC32 recorded in the manifest. Returns the
+ * size of the ROM, or 0 on failure.
+ */
+unsigned pfu_romfs_load(unsigned index, void *dst, unsigned size, u32 *hash);
+
+#endif
@@ -0,0 +1,154 @@
+#include <libdragon.h>
+#include <ctype.h>
+
+#include "memory.h"
+#include "romlist.h"
+
+/**
+ * Names are stored back to back in one pool. The list itself is a few small
+ * arrays indexed by entry, plus the sorted order as 16-bit entry numbers,
+ * so searching touches little memory besides the names compared.
+ */
+typedef struct
+{
+  char *pool;
+  unsigned pool_used;
+  u16 *names;
+  u8 *sources;
+  u16 *order;
+  unsigned count;
+} pfu_romlist_t;
+
+static pfu_romlist_t romlist;
+
+static int pfu_romlist_fold(char c)
+{
+  return c == '_' ? ' ' : tolower((unsigned char)c);
+}
+
+/**
+ * Compares up to length characters of two names as they sort.
+ */
+static int pfu_romlist_compare(const char *a, const char *b, unsigned length)
+{
+  unsigned i;
+
+  for (i = 0; i < length; i++)
+  {
+    int x = pfu_romlist_fold(a[i]), y = pfu_romlist_fold(b[i]);
+
+    if (x != y)
+      return x - y;
+    else if (!x)
+      break;
+  }
+
+  return 0;
+}
+
+/**
+ * Binary searches the sorted order for the first position whose name
+ * compares above the key (upper) or not below it (lower).
+ */
+static unsigned pfu_romlist_bound(const char *key, unsigned length, bool upper)
+{
+  unsigned low = 0, high = romlist.count;
+
+  while (low < high)
+  {
+    unsigned mid = low + (high - low) / 2;
+    int order = pfu_romlist_compare(pfu_romlist_name(mid), key, length);
+
+    if (order < 0 || (upper && !order))
+      low = mid + 1;
+    else
+      high = mid;
+  }
+
+  return low;
+}
+
+void pfu_romlist_clear(void)
+{
+  if (!romlist.pool)
+  {
+    romlist.pool = pfu_malloc(PFU_MEMORY_MENU, PFU_ROMLIST_POOL_SIZE);
+    romlist.names = pfu_malloc(PFU_MEMORY_MENU, PFU_ROMLIST_MAX_ENTRIES * sizeof(u16));
+    romlist.sources = pfu_malloc(PFU_MEMORY_MENU, PFU_ROMLIST_MAX_ENTRIES);
+    romlist.order = pfu_malloc(PFU_MEMORY_MENU, PFU_ROMLIST_MAX_ENTRIES * sizeof(u16));
+  }
+  romlist.pool_used = 0;
+  romlist.count = 0;
+}
+
+bool pfu_romlist_add(const char *name, unsigned source)
+{
+  unsigned length = strlen(name) + 1, position;
+
+  if (!romlist.pool || !romlist.names || !romlist.sources || !romlist.order ||
+      romlist.count >= PFU_ROMLIST_MAX_ENTRIES ||
+      romlist.pool_used + length > PFU_ROMLIST_POOL_SIZE)
+    return false;
+
+  memcpy(&romlist.pool[romlist.pool_used], name, length);
+  romlist.names[romlist.count] = romlist.pool_used;
+  romlist.sources[romlist.count] = source;
+  romlist.pool_used += length;
+
+  /* Insert after any equal names, so they keep the order they were added */
+  position = pfu_romlist_bound(name, ~0u, true);
+  memmove(&romlist.order[position + 1], &romlist.order[position],
+          (romlist.count - position) * sizeof(u16));
+  romlist.order[position] = romlist.count;
+  romlist.count++;
+
+  return true;
+}
+
+unsigned pfu_romlist_count(void)
+{
+  return romlist.count;
+}
+
+const char *pfu_romlist_name(unsigned position)
+{
+  return position < romlist.count ?
+    &romlist.pool[romlist.names[romlist.order[position]]] : "";
+}
+
+unsigned pfu_romlist_source(unsigned position)
+{
+  return position < romlist.count ?
+    romlist.sources[romlist.order[position]] : 0;
+}
+
+void pfu_romlist_find(const char *prefix, unsigned *first, unsigned *last)
+{
+  unsigned length = strlen(prefix);
+
+  *first = pfu_romlist_bound(prefix, length, false);
+  *last = pfu_romlist_bound(prefix, length, true);
+}
+
+unsigned pfu_romlist_letter(unsigned position, int direction)
+{
+  char key[2] = { 0, 0 };
+  unsigned start;
+
+  if (position >= romlist.count)
+    return romlist.count;
+  key[0] = pfu_romlist_fold(pfu_romlist_name(position)[0]);
+
+  if (direction > 0)
+  {
+    key[0]++;
+    return pfu_romlist_bound(key, 1, false);
+  }
+
+  start = pfu_romlist_bound(key, 1, false);
+  if (start < position || !position)
+    return start;
+  key[0] = pfu_romlist_fold(pfu_romlist_name(position - 1)[0]);
+
+  return pfu_romlist_bound(key, 1, false);
+}
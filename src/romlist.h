@@ -0,0 +1,44 @@
+#ifndef PRESS_F_ULTRA_ROMLIST_H
+#define PRESS_F_ULTRA_ROMLIST_H
+
+#include "libpressf/src/emu.h"
+
+/* Most ROMs listed, and bytes of name storage shared between them */
+#define PFU_ROMLIST_MAX_ENTRIES 2048
+#define PFU_ROMLIST_POOL_SIZE 0x10000
+
+/**
+ * Empties the ROM list, allocating it on first use.
+ */
+void pfu_romlist_clear(void);
+
+/**
+ * Adds a ROM to the list, keeping it sorted by name. Names are ordered
+ * without regard to case, and with underscores treated as spaces, as they
+ * are displayed. Returns false if the list is full.
+ */
+bool pfu_romlist_add(const char *name, unsigned source);
+
+unsigned pfu_romlist_count(void);
+
+/**
+ * Returns the name or source of the ROM at a position in sorted order.
+ */
+const char *pfu_romlist_name(unsigned position);
+
+unsigned pfu_romlist_source(unsigned position);
+
+/**
+ * Finds the range of positions [first, last) of ROMs whose names start with
+ * the given prefix. An empty prefix matches every ROM.
+ */
+void pfu_romlist_find(const char *prefix, unsigned *first, unsigned *last);
+
+/**
+ * Returns the position of the first ROM starting with the letter after
+ * (direction > 0) or before (direction < 0) that of the given position.
+ * A backward jump first goes to the start of the current letter.
+ */
+unsigned pfu_romlist_letter(unsigned position, int direction);
+
+#endif
@@ -0,0 +1,29 @@
+#include <libdragon.h>
+
+#include "main.h"
+#include "state.h"
+
+/**
+ * Snapshots go through the core's serialization interface, as devices
+ * behind f8devices own state the frontend cannot see.
+ */
+unsigned pfu_state_size(void)
+{
+  return pressf_serialize_size(&emu.system);
+}
+
+bool pfu_state_save(void *dst, unsigned size)
+{
+  if (!dst || size < pfu_state_size())
+    return false;
+  else
+    return pressf_serialize(&emu.system, dst, size);
+}
+
+bool pfu_state_load(const void *src, unsigned size)
+{
+  if (!src || size < pfu_state_size())
+    return false;
+  else
+    return pressf_unserialize(&emu.system, src, size);
+}
@@ -0,0 +1,22 @@
+#ifndef PRESS_F_ULTRA_STATE_H
+#define PRESS_F_ULTRA_STATE_H
+
+#include "libpressf/src/emu.h"
+
+/**
+ * Returns the size in bytes of a full emulator state snapshot.
+ */
+unsigned pfu_state_size(void);
+
+/**
+ * Takes a snapshot of the full emulator state, including device state behind
+ * the f8devices table. Returns true on success.
+ */
+bool pfu_state_save(void *dst, unsigned size);
+
+/**
+ * Restores a snapshot taken with pfu_state_save. Returns true on success.
+ */
+bool pfu_state_load(const void *src, unsigned size);
+
+#endif
@@ -0,0 +1,93 @@
+#include <libdragon.h>
+
+#include "stats.h"
+
+#define PFU_STATS_BOOT_PHASES 16
+
+typedef struct
+{
+  const char *name;
+  u32 ticks;
+} pfu_stats_boot_phase_t;
+
+pfu_stats_t pfu_stats;
+
+static pfu_stats_boot_phase_t pfu_stats_boot[PFU_STATS_BOOT_PHASES];
+static unsigned pfu_stats_boot_count;
+
+void pfu_stats_frame(void)
+{
+  u32 now = get_ticks();
+
+  if (!pfu_stats.frame_budget)
+    pfu_stats.frame_budget = TICKS_PER_SECOND /
+      (get_tv_type() == TV_TYPE_PAL ? 50 : 60);
+  else
+  {
+    pfu_stats.frame_ticks = now - pfu_stats.frame_start;
+
+    /* Round to the nearest refresh, as vsync timing jitters slightly */
+    if (pfu_stats.frame_ticks > pfu_stats.frame_budget + pfu_stats.frame_budget / 2)
+      pfu_stats.dropped_frames +=
+        (pfu_stats.frame_ticks + pfu_stats.frame_budget / 2) /
+        pfu_stats.frame_budget - 1;
+    pfu_stats.wait_ticks = pfu_stats.wait_accum;
+    pfu_stats.wait_percent = pfu_stats.frame_ticks ?
+      (unsigned)((unsigned long long)pfu_stats.wait_ticks * 100 /
+                 pfu_stats.frame_ticks) : 0;
+  }
+  pfu_stats.wait_accum = 0;
+  pfu_stats.frame_start = now;
+}
+
+void pfu_stats_wait(u32 ticks)
+{
+  pfu_stats.wait_accum += ticks;
+}
+
+void pfu_stats_log(const char *format, ...)
+{
+  FILE *file = fopen(PFU_PATH_STATS_LOG, "a");
+
+  if (file)
+  {
+    va_list args;
+
+    va_start(args, format);
+    vfprintf(file, format, args);
+    va_end(args);
+    fputc('\n', file);
+    fclose(file);
+  }
+}
+
+void pfu_stats_boot_mark(const char *phase)
+{
+  if (pfu_stats_boot_count < PFU_STATS_BOOT_PHASES)
+  {
+    pfu_stats_boot[pfu_stats_boot_count].name = phase;
+    pfu_stats_boot[pfu_stats_boot_count].ticks = get_ticks();
+    pfu_stats_boot_count++;
+  }
+}
+
+void pfu_stats_boot_log(const char *path)
+{
+  char line[512];
+  int length;
+  unsigned i;
+
+  if (!pfu_stats_boot_count)
+    return;
+
+  length = snprintf(line, sizeof(line), "startup path=%s", path);
+  for (i = 1; i < pfu_stats_boot_count && length < (int)sizeof(line); i++)
+    length += snprintf(&line[length], sizeof(line) - length, " %s=%lu",
+      pfu_stats_boot[i].name,
+      (unsigned long)(pfu_stats_boot[i].ticks - pfu_stats_boot[i - 1].ticks));
+  if (length < (int)sizeof(line))
+    snprintf(&line[length], sizeof(line) - length, " total=%lu",
+      (unsigned long)(pfu_stats_boot[pfu_stats_boot_count - 1].ticks -
+                      pfu_stats_boot[0].ticks));
+  pfu_stats_log("%s", line);
+}
@@ -0,0 +1,71 @@
+#ifndef PRESS_F_ULTRA_STATS_H
+#define PRESS_F_ULTRA_STATS_H
+
+#include "libpressf/src/emu.h"
+
+#define PFU_PATH_STATS_LOG "sd:/press-f/stats.txt"
+
+typedef struct
+{
+  /* Ticks at the start of the current frame */
+  u32 frame_start;
+
+  /* Ticks taken by the previous frame, including waiting for vsync */
+  u32 frame_ticks;
+
+  /* Ticks available to one frame at the current TV refresh rate */
+  u32 frame_budget;
+
+  /* Count of display refreshes missed since boot */
+  unsigned dropped_frames;
+
+  /**
+   * Ticks of the previous frame spent blocked in audio_push and display_get
+   * waiting for a free buffer, and that as a percentage of the frame. This
+   * is host time the frontend could use for other work, not guest idle time.
+   */
+  u32 wait_ticks;
+  unsigned wait_percent;
+
+  /* Wait ticks accumulated so far in the current frame */
+  u32 wait_accum;
+
+  /**
+   * Ticks spent in pressf_run for the last emulated frame. The VR4300 has
+   * no cache miss counter, so changes to data layout are measured here.
+   */
+  u32 emulation_ticks;
+} pfu_stats_t;
+
+extern pfu_stats_t pfu_stats;
+
+/**
+ * Marks the start of a frame of the main loop, accounting the duration of
+ * the previous one and any display refreshes it missed.
+ */
+void pfu_stats_frame(void);
+
+/**
+ * Accounts time the current frame spent blocked on an audio or display
+ * buffer rather than working.
+ */
+void pfu_stats_wait(u32 ticks);
+
+/**
+ * Appends a line to the statistics log on the SD Card. This opens the file,
+ * so it is meant for one-off measurements rather than every frame.
+ */
+void pfu_stats_log(const char *format, ...);
+
+/**
+ * Records the end of a startup phase, for the boot timeline.
+ */
+void pfu_stats_boot_mark(const char *phase);
+
+/**
+ * Writes the boot timeline to the statistics log, as ticks spent in each
+ * phase. Called once the first frame has been shown.
+ */
+void pfu_stats_boot_log(const char *path);
+
+#endif
@@ -0,0 +1,379 @@
+#include <libdragon.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "emu.h"
+#include "error.h"
+#include "gamedb.h"
+#include "main.h"
+#include "memory.h"
+#include "menu.h"
+#include "state.h"
+#include "stats.h"
+#include "suspend.h"
+#include "FastLZ/fastlz.h"
+
+#define PFU_SUSPEND_MAGIC 0x50465355 /* "PFSU" */
+#define PFU_SUSPEND_VERSION 2
+#define PFU_PATH_SUSPEND_TEMP "sd:/press-f/suspend.tmp"
+
+/* Settings slots in the file, indexed by pfu_entry_key */
+#define PFU_SUSPEND_SETTINGS 16
+
+/**
+ * The BIOS and ROM images are kept alongside the core snapshot, so resuming
+ * does not depend on finding their files again.
+ */
+#define PFU_SUSPEND_IMAGE_SIZE (0x0800 + PFU_ROM_MAX_SIZE)
+
+/**
+ * Snapshots are compressed in chunks of this size, each on its own, so
+ * compressing and writing one can be spread over several frames.
+ */
+#define PFU_SUSPEND_CHUNK_SIZE 0x2000
+
+/* FastLZ may expand incompressible data by up to 5% */
+#define PFU_SUSPEND_CHUNK_MAX \
+  (PFU_SUSPEND_CHUNK_SIZE + PFU_SUSPEND_CHUNK_SIZE / 16 + 66)
+
+/**
+ * Starts a suspend file. The core snapshot and the image of guest memory
+ * holding the BIOS and ROM follow as one stream, in chunks of their
+ * compressed size, then their compressed data. compressed_size and crc
+ * cover that whole stream.
+ */
+typedef struct
+{
+  u32 magic;
+  u16 version;
+  u16 reserved;
+  u32 rom_hash;
+  char rom_name[64];
+  signed char settings[PFU_SUSPEND_SETTINGS];
+  u32 state_size;
+  u32 image_size;
+  u32 compressed_size;
+  u32 crc;
+} pfu_suspend_header_t;
+
+typedef enum
+{
+  PFU_SUSPEND_STATE_IDLE = 0,
+
+  PFU_SUSPEND_STATE_OPEN,
+  PFU_SUSPEND_STATE_WRITE,
+  PFU_SUSPEND_STATE_CLOSE,
+
+  PFU_SUSPEND_STATE_SIZE
+} pfu_suspend_state;
+
+typedef struct
+{
+  /* Whether a session has been launched since boot */
+  bool launched;
+  char rom_name[64];
+
+  /* Snapshot being written, compressed one chunk per step */
+  pfu_suspend_state state;
+  pfu_suspend_header_t header;
+  u8 *raw;
+  unsigned size;
+  unsigned written;
+  u8 *chunk;
+  FILE *file;
+  u32 start;
+} pfu_suspend_t;
+
+static pfu_suspend_t suspend;
+
+void pfu_suspend_launch(const char *name)
+{
+  suspend.launched = true;
+  snprintf(suspend.rom_name, sizeof(suspend.rom_name), "%s",
+           name ? name : "Channel F BIOS");
+}
+
+static void pfu_suspend_cancel(void)
+{
+  if (suspend.file)
+  {
+    fclose(suspend.file);
+    remove(PFU_PATH_SUSPEND_TEMP);
+  }
+  suspend.file = NULL;
+  if (suspend.raw)
+    pfu_free(suspend.raw);
+  suspend.raw = NULL;
+  if (suspend.chunk)
+    pfu_free(suspend.chunk);
+  suspend.chunk = NULL;
+  suspend.state = PFU_SUSPEND_STATE_IDLE;
+}
+
+void pfu_suspend_request(void)
+{
+  pfu_suspend_header_t *header = &suspend.header;
+  unsigned state_size = pfu_state_size(), i;
+
+  if (!suspend.launched)
+    return;
+
+  /* A newer snapshot replaces one still being written */
+  pfu_suspend_cancel();
+  suspend.start = get_ticks();
+
+  /* Only copied here; compressing is left to pfu_suspend_step */
+  suspend.size = state_size + PFU_SUSPEND_IMAGE_SIZE;
+  suspend.raw = pfu_malloc(PFU_MEMORY_STATE, suspend.size);
+  if (!suspend.raw || !pfu_state_save(suspend.raw, state_size))
+  {
+    pfu_suspend_cancel();
+    return;
+  }
+  memcpy(&suspend.raw[state_size], emu.system.memory, PFU_SUSPEND_IMAGE_SIZE);
+
+  memset(header, 0, sizeof(*header));
+  header->magic = PFU_SUSPEND_MAGIC;
+  header->version = PFU_SUSPEND_VERSION;
+  header->rom_hash = frontend.rom_hash;
+  snprintf(header->rom_name, sizeof(header->rom_name), "%s", suspend.rom_name);
+  for (i = 0; i < PFU_SUSPEND_SETTINGS && i < PFU_ENTRY_KEY_SIZE; i++)
+    header->settings[i] = pfu_menu_get_setting(i);
+  header->state_size = state_size;
+  header->image_size = PFU_SUSPEND_IMAGE_SIZE;
+  suspend.written = 0;
+  suspend.state = PFU_SUSPEND_STATE_OPEN;
+}
+
+void pfu_suspend_step(void)
+{
+  switch (suspend.state)
+  {
+  case PFU_SUSPEND_STATE_OPEN:
+    /**
+     * Written aside and renamed, so a power cut never leaves half a file.
+     * The header is written again once the stream's size and CRC are known.
+     */
+    suspend.chunk = pfu_malloc(PFU_MEMORY_STATE, PFU_SUSPEND_CHUNK_MAX);
+    suspend.file = fopen(PFU_PATH_SUSPEND_TEMP, "wb");
+    if (!suspend.chunk || !suspend.file ||
+        fwrite(&suspend.header, sizeof(suspend.header), 1, suspend.file) != 1)
+      pfu_suspend_cancel();
+    else
+      suspend.state = PFU_SUSPEND_STATE_WRITE;
+    break;
+  case PFU_SUSPEND_STATE_WRITE:
+  {
+    unsigned size = suspend.size - suspend.written;
+    u32 compressed_size;
+
+    if (size > PFU_SUSPEND_CHUNK_SIZE)
+      size = PFU_SUSPEND_CHUNK_SIZE;
+
+    /* Level 1 favors speed, as this runs between two frames */
+    compressed_size = fastlz_compress_level(1, &suspend.raw[suspend.written],
+                                            size, suspend.chunk);
+    if (!compressed_size ||
+        fwrite(&compressed_size, sizeof(compressed_size), 1, suspend.file) != 1 ||
+        fwrite(suspend.chunk, 1, compressed_size, suspend.file) != compressed_size)
+    {
+      pfu_suspend_cancel();
+      break;
+    }
+    suspend.header.crc = pfu_crc32(suspend.header.crc, &compressed_size,
+                                   sizeof(compressed_size));
+    suspend.header.crc = pfu_crc32(suspend.header.crc, suspend.chunk,
+                                   compressed_size);
+    suspend.header.compressed_size += sizeof(compressed_size) + compressed_size;
+    suspend.written += size;
+    if (suspend.written >= suspend.size)
+      suspend.state = PFU_SUSPEND_STATE_CLOSE;
+    break;
+  }
+  case PFU_SUSPEND_STATE_CLOSE:
+  {
+    bool closed = !fseek(suspend.file, 0, SEEK_SET) &&
+      fwrite(&suspend.header, sizeof(suspend.header), 1, suspend.file) == 1;
+
+    closed = !fclose(suspend.file) && closed;
+    suspend.file = NULL;
+    if (!closed)
+    {
+      remove(PFU_PATH_SUSPEND_TEMP);
+      pfu_suspend_cancel();
+      break;
+    }
+    remove(PFU_PATH_SUSPEND);
+    rename(PFU_PATH_SUSPEND_TEMP, PFU_PATH_SUSPEND);
+    pfu_stats_log("suspend bytes=%lu total_us=%lu",
+                  (unsigned long)(sizeof(suspend.header) +
+                                  suspend.header.compressed_size),
+                  (unsigned long)TICKS_TO_US(get_ticks() - suspend.start));
+    pfu_suspend_cancel();
+    break;
+  }
+  default:
+    break;
+  }
+}
+
+void pfu_suspend_finish(void)
+{
+  while (suspend.state != PFU_SUSPEND_STATE_IDLE)
+    pfu_suspend_step();
+}
+
+/**
+ * Reads and decompresses the snapshot stream of a suspend file into raw,
+ * checking it against the header. Nothing is applied.
+ */
+static bool pfu_suspend_read(FILE *file, const pfu_suspend_header_t *header,
+                             u8 *raw)
+{
+  const unsigned size = header->state_size + header->image_size;
+  u8 *compressed = pfu_malloc(PFU_MEMORY_STATE, PFU_SUSPEND_CHUNK_MAX);
+  unsigned read = 0, consumed = 0;
+  u32 crc = 0;
+
+  while (compressed && read < size)
+  {
+    unsigned chunk = size - read;
+    u32 compressed_size;
+
+    if (chunk > PFU_SUSPEND_CHUNK_SIZE)
+      chunk = PFU_SUSPEND_CHUNK_SIZE;
+    if (fread(&compressed_size, sizeof(compressed_size), 1, file) != 1 ||
+        compressed_size > PFU_SUSPEND_CHUNK_MAX ||
+        fread(compressed, 1, compressed_size, file) != compressed_size ||
+        fastlz_decompress(compressed, compressed_size, &raw[read], chunk) !=
+          (int)chunk)
+      break;
+    crc = pfu_crc32(crc, &compressed_size, sizeof(compressed_size));
+    crc = pfu_crc32(crc, compressed, compressed_size);
+    consumed += sizeof(compressed_size) + compressed_size;
+    read += chunk;
+  }
+  pfu_free(compressed);
+
+  return read == size && consumed == header->compressed_size &&
+         crc == header->crc;
+}
+
+/**
+ * Asks whether to resume the suspended session. Returns true if A was
+ * pressed, or false for B.
+ */
+static bool pfu_suspend_prompt(const char *name)
+{
+  surface_t *disp;
+
+  pfu_assets_init();
+  disp = display_get();
+  rdpq_attach_clear(disp, NULL);
+  rdpq_set_mode_fill(RGBA32(0x22, 0x22, 0x22, 1));
+  rdpq_fill_rectangle(0, 0, display_get_width(), display_get_height());
+
+  rdpq_set_mode_copy(false);
+  rdpq_sprite_blit(frontend.icon, 48, 32, NULL);
+  rdpq_text_printf(
+    &(rdpq_textparms_t){
+      .width = 640 - 64*2,
+      .height = 480 - 64*2,
+      .align = ALIGN_CENTER
+    }, PFU_FONT_MAIN, 64, 128,
+    "A suspended session was found:\n%s\n\n"
+    "Press A to resume, or B to choose a ROM.", name);
+  rdpq_detach_show();
+
+  while (1)
+  {
+    joypad_buttons_t buttons;
+
+    joypad_poll();
+    buttons = joypad_get_buttons_pressed(JOYPAD_PORT_1);
+    if (buttons.a)
+      return true;
+    else if (buttons.b)
+      return false;
+  }
+}
+
+bool pfu_suspend_resume(void)
+{
+  pfu_suspend_header_t header;
+  bool resumed = false;
+  u8 *raw, *backup;
+  FILE *file;
+  u32 start;
+  unsigned size, i;
+
+  file = fopen(PFU_PATH_SUSPEND, "rb");
+  if (!file)
+    return false;
+  if (fread(&header, sizeof(header), 1, file) != 1 ||
+      header.magic != PFU_SUSPEND_MAGIC ||
+      header.version != PFU_SUSPEND_VERSION ||
+      header.state_size != pfu_state_size() ||
+      header.image_size != PFU_SUSPEND_IMAGE_SIZE)
+  {
+    fclose(file);
+    return false;
+  }
+  header.rom_name[sizeof(header.rom_name) - 1] = '\0';
+  if (!pfu_suspend_prompt(header.rom_name))
+  {
+    fclose(file);
+    return false;
+  }
+  pfu_stats_boot_mark("resume_prompt");
+  start = get_ticks();
+
+  /**
+   * The whole file is checked before anything is applied. The core can
+   * still reject the snapshot itself, so the state it replaces is kept to
+   * roll back to.
+   */
+  size = header.state_size + header.image_size;
+  raw = pfu_malloc(PFU_MEMORY_STATE, size);
+  backup = pfu_malloc(PFU_MEMORY_STATE, size);
+  if (raw && backup && pfu_suspend_read(file, &header, raw) &&
+      pfu_state_save(backup, header.state_size))
+  {
+    memcpy(&backup[header.state_size], emu.system.memory, header.image_size);
+    f8_write(&emu.system, 0x0000, &raw[header.state_size], header.image_size);
+    if (pfu_state_load(raw, header.state_size))
+    {
+      /* Settings that write to guest memory match the restored image */
+      for (i = 1; i < PFU_SUSPEND_SETTINGS && i < PFU_ENTRY_KEY_SIZE; i++)
+        if (pfu_menu_key_persists(i))
+          pfu_menu_set_setting(i, header.settings[i]);
+      frontend.bios_a_loaded = true;
+      frontend.bios_b_loaded = true;
+      frontend.rom_hash = header.rom_hash;
+      pfu_suspend_launch(header.rom_name);
+      resumed = true;
+    }
+    else
+    {
+      f8_write(&emu.system, 0x0000, &backup[header.state_size],
+               header.image_size);
+      pfu_state_load(backup, header.state_size);
+    }
+  }
+  fclose(file);
+  pfu_free(raw);
+  pfu_free(backup);
+
+  if (resumed)
+  {
+    pfu_stats_log("suspend resume rom=%08lX resume_us=%lu",
+                  (unsigned long)header.rom_hash,
+                  (unsigned long)TICKS_TO_US(get_ticks() - start));
+    pfu_stats_boot_mark("resume");
+  }
+  else
+    pfu_message_switch(PFU_STATE_MENU,
+      "Failed to resume the suspended session:\n%s", PFU_PATH_SUSPEND);
+
+  return resumed;
+}
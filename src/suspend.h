@@ -0,0 +1,41 @@
+#ifndef PRESS_F_ULTRA_SUSPEND_H
+#define PRESS_F_ULTRA_SUSPEND_H
+
+#include "libpressf/src/emu.h"
+
+#define PFU_PATH_SUSPEND "sd:/press-f/suspend.pfs"
+
+/**
+ * Called when a ROM, or the BIOS alone, is booted. name is shown when
+ * offering to resume the session, and may be NULL for the BIOS.
+ */
+void pfu_suspend_launch(const char *name);
+
+/**
+ * Takes a snapshot of the running session and the settings now. Compressing
+ * and writing it are deferred to pfu_suspend_step. Does nothing if no
+ * session has been launched.
+ */
+void pfu_suspend_request(void);
+
+/**
+ * Compresses and writes one chunk of a pending snapshot. Called once per
+ * frame of the main loop so suspending never stalls a frame.
+ */
+void pfu_suspend_step(void);
+
+/**
+ * Writes out any pending snapshot at once, for when the session it was taken
+ * from is about to be replaced.
+ */
+void pfu_suspend_finish(void);
+
+/**
+ * Called at boot. If a suspended session is on the SD Card, asks whether to
+ * resume it, then restores it without scanning for ROMs or booting the BIOS.
+ * Nothing is applied unless the whole snapshot is valid. Returns true if the
+ * session was resumed.
+ */
+bool pfu_suspend_resume(void);
+
+#endif
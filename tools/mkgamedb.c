@@ -0,0 +1,313 @@
+/**
+ * mkgamedb - Builds the Press F Ultra game database.
+ *
+ * Usage: mkgamedb <input.txt> <output.bin> [rom...]
+ *
+ * Each non-empty, non-comment line of the input describes one title:
+ *
+ *   <crc32> <clock> <font> <swap> <flags> <title...>
+ *
+ * crc32: CRC32 of the ROM in hex, or @<name> to hash every given ROM whose
+ *        file name contains <name> as whole words. Case is ignored, and
+ *        underscores in <name> match spaces or underscores.
+ * clock: ntsc, pal1, pal2, or - for no preference
+ * font:  fairchild, cute, skinny, or - for no preference
+ * swap:  on, off, or - for no preference
+ * flags: comma-separated list of good, issues, or - for none
+ *
+ * The title is for documentation only and is not stored. Records are written
+ * sorted by hash so the frontend can binary search them.
+ *
+ * The frontend hashes a ROM as far as it loads it, which is less in builds
+ * with the accurate ROMC mode. ROMs longer than that get a record for each
+ * hash, so the same database serves both builds.
+ */
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GAMEDB_MAGIC 0x50464442
+#define GAMEDB_VERSION 2
+#define GAMEDB_UNSET 0xFF
+#define GAMEDB_MAX_ENTRIES 0xFFFF
+/* Largest ROM the frontend loads, and so hashes, without and with ROMC */
+#define GAMEDB_MAX_ROM_SIZE 0xF800
+#define GAMEDB_MAX_ROM_SIZE_ROMC 0x4000
+
+typedef struct
+{
+  unsigned long hash;
+  unsigned char clock;
+  unsigned char font;
+  unsigned char swap;
+  unsigned char flags;
+  unsigned line;
+} gamedb_entry_t;
+
+static const char *clock_names[] = { "ntsc", "pal1", "pal2", NULL };
+static const char *font_names[] = { "fairchild", "cute", "skinny", NULL };
+static const char *swap_names[] = { "off", "on", NULL };
+static const char *flag_names[] = { "good", "issues", NULL };
+static unsigned long crc_table[256];
+
+static int lookup(const char **names, const char *value)
+{
+  int i;
+
+  if (!strcmp(value, "-"))
+    return GAMEDB_UNSET;
+  for (i = 0; names[i]; i++)
+    if (!strcmp(names[i], value))
+      return i;
+
+  return -1;
+}
+
+static int parse_flags(char *value)
+{
+  int flags = 0;
+  char *token;
+
+  if (!strcmp(value, "-"))
+    return 0;
+  for (token = strtok(value, ","); token; token = strtok(NULL, ","))
+  {
+    int flag = lookup(flag_names, token);
+
+    if (flag < 0 || flag == GAMEDB_UNSET)
+      return -1;
+    flags |= 1 << flag;
+  }
+
+  return flags;
+}
+
+static void crc_init(void)
+{
+  unsigned long c;
+  unsigned i, j;
+
+  for (i = 0; i < 256; i++)
+  {
+    c = i;
+    for (j = 0; j < 8; j++)
+      c = c & 1 ? 0xEDB88320UL ^ (c >> 1) : c >> 1;
+    crc_table[i] = c;
+  }
+}
+
+/**
+ * Returns the CRC32 of a ROM file as the frontend computes it while loading,
+ * both without and with ROMC, or -1 if the file can't be read. The two are
+ * the same for ROMs that fit the smaller limit.
+ */
+static int hash_file(const char *path, unsigned long *hash,
+                     unsigned long *hash_romc)
+{
+  static unsigned char buffer[GAMEDB_MAX_ROM_SIZE];
+  unsigned long crc = 0xFFFFFFFFUL;
+  FILE *file = fopen(path, "rb");
+  size_t size, i;
+
+  if (!file)
+    return -1;
+  size = fread(buffer, 1, sizeof(buffer), file);
+  fclose(file);
+  for (i = 0; i < size; i++)
+  {
+    if (i == GAMEDB_MAX_ROM_SIZE_ROMC)
+      *hash_romc = ~crc & 0xFFFFFFFFUL;
+    crc = crc_table[(crc ^ buffer[i]) & 0xFF] ^ (crc >> 8);
+  }
+  *hash = ~crc & 0xFFFFFFFFUL;
+  if (size <= GAMEDB_MAX_ROM_SIZE_ROMC)
+    *hash_romc = *hash;
+
+  return 0;
+}
+
+static int name_char(char c)
+{
+  return c == ' ' ? '_' : tolower((unsigned char)c);
+}
+
+/**
+ * Returns whether the file name of a ROM path contains a name as whole
+ * words, so titles are found whatever a dump is prefixed or tagged with.
+ */
+static int name_matches(const char *path, const char *name)
+{
+  const char *base = strrchr(path, '/');
+  const char *start;
+
+  base = base ? base + 1 : path;
+  for (start = base; *start; start++)
+  {
+    unsigned i;
+
+    if (start > base && isalnum((unsigned char)start[-1]))
+      continue;
+    for (i = 0; name[i] && name_char(name[i]) == name_char(start[i]); i++);
+    if (!name[i] && !isalnum((unsigned char)start[i]))
+      return 1;
+  }
+
+  return 0;
+}
+
+static int add_entry(gamedb_entry_t *entries, unsigned *count,
+                     const gamedb_entry_t *entry, const char *path)
+{
+  if (*count >= GAMEDB_MAX_ENTRIES)
+  {
+    fprintf(stderr, "%s: too many entries\n", path);
+    return 1;
+  }
+  entries[(*count)++] = *entry;
+
+  return 0;
+}
+
+static int compare_entries(const void *a, const void *b)
+{
+  const gamedb_entry_t *x = (const gamedb_entry_t*)a;
+  const gamedb_entry_t *y = (const gamedb_entry_t*)b;
+
+  return x->hash < y->hash ? -1 : x->hash > y->hash;
+}
+
+static void write_u32(FILE *file, unsigned long value)
+{
+  fputc((value >> 24) & 0xFF, file);
+  fputc((value >> 16) & 0xFF, file);
+  fputc((value >> 8) & 0xFF, file);
+  fputc(value & 0xFF, file);
+}
+
+int main(int argc, char **argv)
+{
+  FILE *input, *output;
+  gamedb_entry_t *entries;
+  unsigned count = 0, line_number = 0, i;
+  char line[1024];
+  int rom;
+
+  if (argc < 3)
+  {
+    fprintf(stderr, "Usage: %s <input.txt> <output.bin> [rom...]\n", argv[0]);
+    return 1;
+  }
+  crc_init();
+
+  input = fopen(argv[1], "r");
+  if (!input)
+  {
+    fprintf(stderr, "Failed to open %s\n", argv[1]);
+    return 1;
+  }
+  entries = calloc(GAMEDB_MAX_ENTRIES, sizeof(gamedb_entry_t));
+
+  while (fgets(line, sizeof(line), input))
+  {
+    char hash[128], clock[32], font[32], swap[32], flags[128];
+    int clock_value, font_value, swap_value, flags_value;
+    gamedb_entry_t entry;
+    char *end;
+
+    line_number++;
+    if (line[0] == '#' || sscanf(line, "%127s", hash) != 1)
+      continue;
+    if (sscanf(line, "%127s %31s %31s %31s %127s",
+               hash, clock, font, swap, flags) != 5)
+    {
+      fprintf(stderr, "%s:%u: expected hash, clock, font, swap and flags\n",
+              argv[1], line_number);
+      return 1;
+    }
+
+    clock_value = lookup(clock_names, clock);
+    font_value = lookup(font_names, font);
+    swap_value = lookup(swap_names, swap);
+    flags_value = parse_flags(flags);
+    if (clock_value < 0 || font_value < 0 || swap_value < 0 || flags_value < 0)
+    {
+      fprintf(stderr, "%s:%u: unknown clock, font, swap or flag\n",
+              argv[1], line_number);
+      return 1;
+    }
+    entry.clock = (unsigned char)clock_value;
+    entry.font = (unsigned char)font_value;
+    entry.swap = (unsigned char)swap_value;
+    entry.flags = (unsigned char)flags_value;
+    entry.line = line_number;
+
+    /* Titles named rather than hashed get a record for each matching ROM */
+    if (hash[0] != '@')
+    {
+      entry.hash = strtoul(hash, &end, 16) & 0xFFFFFFFFUL;
+      if (*end != '\0')
+      {
+        fprintf(stderr, "%s:%u: invalid hash \"%s\"\n",
+                argv[1], line_number, hash);
+        return 1;
+      }
+      if (add_entry(entries, &count, &entry, argv[1]))
+        return 1;
+    }
+    else for (rom = 3; rom < argc; rom++)
+    {
+      unsigned long hash_romc;
+
+      if (!name_matches(argv[rom], &hash[1]))
+        continue;
+      else if (hash_file(argv[rom], &entry.hash, &hash_romc))
+      {
+        fprintf(stderr, "Failed to read %s\n", argv[rom]);
+        return 1;
+      }
+      else if (add_entry(entries, &count, &entry, argv[1]))
+        return 1;
+      else if (hash_romc != entry.hash)
+      {
+        entry.hash = hash_romc;
+        if (add_entry(entries, &count, &entry, argv[1]))
+          return 1;
+      }
+    }
+  }
+  fclose(input);
+
+  qsort(entries, count, sizeof(gamedb_entry_t), compare_entries);
+  for (i = 1; i < count; i++)
+    if (entries[i].hash == entries[i - 1].hash)
+    {
+      fprintf(stderr, "%s:%u: duplicate hash %08lX (first on line %u)\n",
+              argv[1], entries[i].line, entries[i].hash, entries[i - 1].line);
+      return 1;
+    }
+
+  output = fopen(argv[2], "wb");
+  if (!output)
+  {
+    fprintf(stderr, "Failed to open %s\n", argv[2]);
+    return 1;
+  }
+  write_u32(output, GAMEDB_MAGIC);
+  fputc((GAMEDB_VERSION >> 8) & 0xFF, output);
+  fputc(GAMEDB_VERSION & 0xFF, output);
+  fputc((count >> 8) & 0xFF, output);
+  fputc(count & 0xFF, output);
+  for (i = 0; i < count; i++)
+  {
+    write_u32(output, entries[i].hash);
+    fputc(entries[i].clock, output);
+    fputc(entries[i].font, output);
+    fputc(entries[i].flags, output);
+    fputc(entries[i].swap, output);
+  }
+  fclose(output);
+  free(entries);
+
+  return 0;
+}
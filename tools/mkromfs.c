@@ -0,0 +1,244 @@
+/**
+ * mkromfs - Packs the bundled ROMs into one compressed file.
+ *
+ * Usage: mkromfs <output.pak> <rom...>
+ *
+ * Each ROM is compressed with FastLZ, or stored as-is if that does not make
+ * it smaller. The output starts with a manifest so the frontend can list
+ * every ROM with one read:
+ *
+ *   header:  magic "PFRP", u16 version, u16 count, u32 manifest size
+ *   entries: count records of u32 offset, u32 stored size, u32 size,
+ *            u32 CRC32 of the ROM, u16 name offset, u16 reserved
+ *   names:   NUL-terminated file names, referenced by name offset
+ *
+ * The manifest size covers the entries and names. ROM data follows it, at
+ * offsets from the start of the file. Entries are sorted by name, and all
+ * values are big-endian.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "FastLZ/fastlz.h"
+
+#define ROMFS_MAGIC 0x50465250
+#define ROMFS_VERSION 1
+#define ROMFS_HEADER_SIZE 12
+#define ROMFS_ENTRY_SIZE 20
+#define ROMFS_MAX_ENTRIES 0xFFFF
+#define ROMFS_MAX_NAMES 0xFFFF
+
+/* Largest ROM the frontend loads, as PFU_ROM_MAX_SIZE for the same build */
+#ifndef PF_ROMC
+#define PF_ROMC 0
+#endif
+#if PF_ROMC
+#define ROMFS_MAX_ROM_SIZE 0x4000
+#else
+#define ROMFS_MAX_ROM_SIZE 0xF800
+#endif
+
+typedef struct
+{
+  const char *path;
+  const char *name;
+  unsigned char *data;
+  unsigned long stored_size;
+  unsigned long size;
+  unsigned long hash;
+  unsigned long offset;
+  unsigned name_offset;
+} romfs_entry_t;
+
+static unsigned long crc_table[256];
+
+static void crc_init(void)
+{
+  unsigned long c;
+  unsigned i, j;
+
+  for (i = 0; i < 256; i++)
+  {
+    c = i;
+    for (j = 0; j < 8; j++)
+      c = c & 1 ? 0xEDB88320UL ^ (c >> 1) : c >> 1;
+    crc_table[i] = c;
+  }
+}
+
+static unsigned long crc32(const unsigned char *data, unsigned long size)
+{
+  unsigned long crc = 0xFFFFFFFFUL, i;
+
+  for (i = 0; i < size; i++)
+    crc = crc_table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+
+  return ~crc & 0xFFFFFFFFUL;
+}
+
+static int compare_entries(const void *a, const void *b)
+{
+  return strcmp(((const romfs_entry_t*)a)->name,
+                ((const romfs_entry_t*)b)->name);
+}
+
+static void write_u16(FILE *file, unsigned value)
+{
+  fputc((value >> 8) & 0xFF, file);
+  fputc(value & 0xFF, file);
+}
+
+static void write_u32(FILE *file, unsigned long value)
+{
+  write_u16(file, (value >> 16) & 0xFFFF);
+  write_u16(file, value & 0xFFFF);
+}
+
+/**
+ * Reads a ROM and stores it compressed if that saves space.
+ */
+static int load_entry(romfs_entry_t *entry)
+{
+  FILE *file = fopen(entry->path, "rb");
+  unsigned char *raw, *compressed;
+  long size;
+  int compressed_size;
+
+  if (!file)
+  {
+    fprintf(stderr, "Failed to open %s\n", entry->path);
+    return 0;
+  }
+  fseek(file, 0, SEEK_END);
+  size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  if (size <= 0 || size > ROMFS_MAX_ROM_SIZE)
+  {
+    fprintf(stderr, "%s: size %ld is not within the %d bytes loaded\n",
+            entry->path, size, ROMFS_MAX_ROM_SIZE);
+    fclose(file);
+    return 0;
+  }
+  raw = malloc(size);
+  if (!raw || fread(raw, 1, size, file) != (size_t)size)
+  {
+    fprintf(stderr, "Failed to read %s\n", entry->path);
+    fclose(file);
+    free(raw);
+    return 0;
+  }
+  fclose(file);
+
+  entry->size = size;
+  entry->hash = crc32(raw, size);
+
+  /* FastLZ may expand incompressible data by up to 5% */
+  compressed = malloc(size + size / 16 + 66);
+  compressed_size = size < 16 ? 0 : fastlz_compress_level(2, raw, size, compressed);
+  if (compressed_size > 0 && compressed_size < size)
+  {
+    entry->data = compressed;
+    entry->stored_size = compressed_size;
+    free(raw);
+  }
+  else
+  {
+    entry->data = raw;
+    entry->stored_size = size;
+    free(compressed);
+  }
+
+  return 1;
+}
+
+int main(int argc, char **argv)
+{
+  romfs_entry_t *entries;
+  unsigned count = argc - 2, names_size = 0, i;
+  unsigned long manifest_size, offset, total_size = 0, total_stored = 0;
+  FILE *output;
+
+  if (argc < 2)
+  {
+    fprintf(stderr, "Usage: %s <output.pak> <rom...>\n", argv[0]);
+    return 1;
+  }
+  if (count > ROMFS_MAX_ENTRIES)
+  {
+    fprintf(stderr, "Too many ROMs\n");
+    return 1;
+  }
+  crc_init();
+  entries = calloc(count ? count : 1, sizeof(romfs_entry_t));
+
+  for (i = 0; i < count; i++)
+  {
+    const char *name = strrchr(argv[i + 2], '/');
+
+    entries[i].path = argv[i + 2];
+    entries[i].name = name ? name + 1 : argv[i + 2];
+    if (!load_entry(&entries[i]))
+      return 1;
+  }
+  qsort(entries, count, sizeof(romfs_entry_t), compare_entries);
+
+  /* Lay out names, then data after the manifest */
+  for (i = 0; i < count; i++)
+  {
+    if (i && !strcmp(entries[i].name, entries[i - 1].name))
+    {
+      fprintf(stderr, "Duplicate ROM name %s\n", entries[i].name);
+      return 1;
+    }
+    entries[i].name_offset = names_size;
+    names_size += strlen(entries[i].name) + 1;
+    if (names_size > ROMFS_MAX_NAMES)
+    {
+      fprintf(stderr, "ROM names too long\n");
+      return 1;
+    }
+  }
+  manifest_size = count * ROMFS_ENTRY_SIZE + names_size;
+  offset = ROMFS_HEADER_SIZE + manifest_size;
+  for (i = 0; i < count; i++)
+  {
+    entries[i].offset = offset;
+    offset += entries[i].stored_size;
+  }
+
+  output = fopen(argv[1], "wb");
+  if (!output)
+  {
+    fprintf(stderr, "Failed to open %s\n", argv[1]);
+    return 1;
+  }
+  write_u32(output, ROMFS_MAGIC);
+  write_u16(output, ROMFS_VERSION);
+  write_u16(output, count);
+  write_u32(output, manifest_size);
+  for (i = 0; i < count; i++)
+  {
+    write_u32(output, entries[i].offset);
+    write_u32(output, entries[i].stored_size);
+    write_u32(output, entries[i].size);
+    write_u32(output, entries[i].hash);
+    write_u16(output, entries[i].name_offset);
+    write_u16(output, 0);
+  }
+  for (i = 0; i < count; i++)
+    fwrite(entries[i].name, 1, strlen(entries[i].name) + 1, output);
+  for (i = 0; i < count; i++)
+  {
+    fwrite(entries[i].data, 1, entries[i].stored_size, output);
+    total_size += entries[i].size;
+    total_stored += entries[i].stored_size;
+    free(entries[i].data);
+  }
+  fclose(output);
+  free(entries);
+
+  printf("%u ROMs, %lu bytes packed to %lu\n", count, total_size, total_stored);
+
+  return 0;
+}
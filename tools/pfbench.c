@@ -0,0 +1,152 @@
+/**
+ * pfbench - Measures libpressf emulation speed on the host.
+ *
+ * Usage: pfbench <frames> <bios_a> <bios_b> <rom...>
+ *
+ * Each ROM is booted from a reset and run headless for the given number of
+ * frames. ROM paths matching either BIOS path are skipped, so a whole ROM
+ * directory can be passed. Output is one line per ROM:
+ *
+ *   <romc> <frames> <fps> <us_per_frame> <hash> <path>
+ *
+ * The hash is a CRC32 over the VRAM and beeper output of every frame, so
+ * differently-configured builds (for example PF_ROMC=0 and PF_ROMC=1) can be
+ * checked for the same output as well as timed. The format is stable so
+ * their runs can be compared line by line.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "libpressf/src/emu.h"
+#include "libpressf/src/hw/beeper.h"
+#include "libpressf/src/hw/vram.h"
+
+#define BENCH_ROM_ADDRESS 0x0800
+#define BENCH_ROM_MAX 0xF800
+
+static unsigned char bench_buffer[BENCH_ROM_MAX];
+static unsigned long bench_crc_table[256];
+
+static void bench_crc_init(void)
+{
+  unsigned long c;
+  unsigned i, j;
+
+  for (i = 0; i < 256; i++)
+  {
+    c = i;
+    for (j = 0; j < 8; j++)
+      c = c & 1 ? 0xEDB88320UL ^ (c >> 1) : c >> 1;
+    bench_crc_table[i] = c;
+  }
+}
+
+static unsigned long bench_crc(unsigned long crc, const void *data,
+                               unsigned size)
+{
+  const unsigned char *src = (const unsigned char*)data;
+  unsigned i;
+
+  crc = ~crc & 0xFFFFFFFFUL;
+  for (i = 0; i < size; i++)
+    crc = bench_crc_table[(crc ^ src[i]) & 0xFF] ^ (crc >> 8);
+
+  return ~crc & 0xFFFFFFFFUL;
+}
+
+static double bench_seconds(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/**
+ * Writes a file into guest memory through the system bus. Returns the number
+ * of bytes written, or 0 on failure.
+ */
+static unsigned bench_load(f8_system_t *system, unsigned address,
+                           unsigned max_size, const char *path)
+{
+  FILE *file = fopen(path, "rb");
+  size_t size;
+
+  if (!file)
+  {
+    fprintf(stderr, "Failed to open %s\n", path);
+    return 0;
+  }
+  size = fread(bench_buffer, 1, max_size, file);
+  fclose(file);
+  if (size)
+    f8_write(system, address, bench_buffer, size);
+
+  return (unsigned)size;
+}
+
+int main(int argc, char **argv)
+{
+  static f8_system_t system;
+  unsigned frames, frame;
+  int i, failed = 0;
+
+  if (argc < 5)
+  {
+    fprintf(stderr, "Usage: %s <frames> <bios_a> <bios_b> <rom...>\n", argv[0]);
+    return 1;
+  }
+  bench_crc_init();
+  frames = (unsigned)strtoul(argv[1], NULL, 10);
+  if (!frames)
+  {
+    fprintf(stderr, "Frame count must be positive\n");
+    return 1;
+  }
+
+  for (i = 4; i < argc; i++)
+  {
+    double start, elapsed, hashing = 0;
+    unsigned long hash = 0;
+
+    if (!strcmp(argv[i], argv[2]) || !strcmp(argv[i], argv[3]))
+      continue;
+
+    memset(&system, 0, sizeof(system));
+    pressf_init(&system);
+    f8_system_init(&system, F8_SYSTEM_CHANNEL_F);
+    if (!bench_load(&system, 0x0000, 0x0400, argv[2]) ||
+        !bench_load(&system, 0x0400, 0x0400, argv[3]) ||
+        !bench_load(&system, BENCH_ROM_ADDRESS, BENCH_ROM_MAX, argv[i]))
+    {
+      failed = 1;
+      continue;
+    }
+    pressf_reset(&system);
+
+    start = bench_seconds();
+    for (frame = 0; frame < frames; frame++)
+    {
+      double hash_start;
+
+      pressf_run(&system);
+
+      /* Hashing is excluded from the timing */
+      hash_start = bench_seconds();
+      hash = bench_crc(hash, ((vram_t*)system.f8devices[3].device)->data,
+                       sizeof(((vram_t*)0)->data));
+      hash = bench_crc(hash, ((f8_beeper_t*)system.f8devices[7].device)->samples,
+                       sizeof(((f8_beeper_t*)0)->samples));
+      hashing += bench_seconds() - hash_start;
+    }
+    elapsed = bench_seconds() - start - hashing;
+
+    printf("%d %u %.1f %.1f %08lX %s\n", PF_ROMC, frames, frames / elapsed,
+           elapsed * 1e6 / frames, hash, argv[i]);
+  }
+
+  return failed;
+}
@@ -0,0 +1,76 @@
+/**
+ * pfmicro - Times libpressf one F8 instruction class at a time on the host.
+ *
+ * Usage: pfmicro <frames>
+ *
+ * Each class is a synthetic program from src/microbench.c, run for the
+ * given number of frames. Output is one line per class, in the format
+ * documented in microbench.h, so it can be compared with results from the
+ * N64 or from another build of the core.
+ *
+ * Host cycles are read from the time stamp counter where there is one,
+ * which counts at a fixed rate rather than the core clock. Elsewhere they
+ * are reported as 0; use BENCH_RUN="perf stat" for exact counts.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "microbench.h"
+
+static double micro_seconds(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static double micro_cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return (double)__builtin_ia32_rdtsc();
+#else
+  return 0;
+#endif
+}
+
+int main(int argc, char **argv)
+{
+  static f8_system_t system;
+  unsigned frames, frame, i;
+
+  if (argc < 2)
+  {
+    fprintf(stderr, "Usage: %s <frames>\n", argv[0]);
+    return 1;
+  }
+  frames = (unsigned)strtoul(argv[1], NULL, 10);
+  if (!frames)
+  {
+    fprintf(stderr, "Frame count must be positive\n");
+    return 1;
+  }
+
+  memset(&system, 0, sizeof(system));
+  pressf_init(&system);
+  f8_system_init(&system, F8_SYSTEM_CHANNEL_F);
+  pfu_microbench_header(stdout);
+  for (i = 0; i < pfu_microbench_count(); i++)
+  {
+    double start, start_cycles;
+
+    pfu_microbench_load(&system, i);
+    start = micro_seconds();
+    start_cycles = micro_cycles();
+    for (frame = 0; frame < frames; frame++)
+      pressf_run(&system);
+    pfu_microbench_print(stdout, &system, i, frames,
+                         micro_seconds() - start,
+                         micro_cycles() - start_cycles);
+  }
+
+  return 0;
+}